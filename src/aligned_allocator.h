@@ -0,0 +1,52 @@
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+
+//
+// Minimal std allocator returning memory aligned to Alignment bytes (a cache
+//   line by default), so contiguous arrays start on a vector register and
+//   cache line boundary. Use as std::vector<double, AlignedAllocator<double>>.
+//
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+  typedef T value_type;
+
+  template <typename U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t n) {
+    void *p = NULL;
+    if (n == 0) {
+      n = 1;
+    }
+    if (posix_memalign(&p, Alignment, n*sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+    return (T *)p;
+  }
+
+  void deallocate(T *p, size_t) { free(p); }
+};
+
+template <typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment> &,
+                const AlignedAllocator<U, Alignment> &) {
+  return true;
+}
+
+template <typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment> &,
+                const AlignedAllocator<U, Alignment> &) {
+  return false;
+}
+
+#endif  // ALIGNED_ALLOCATOR_H
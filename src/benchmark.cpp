@@ -0,0 +1,1929 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "math.h"
+#include "aligned_allocator.h"
+#include "helpers.h"
+#include "jmt.h"
+#include "json.hpp"
+#include "lane_kernel.h"
+#include "prediction.h"
+#include "spline.h"
+#include "spline_cache.h"
+#include "track_map.h"
+#include "track_model.h"
+#include "tracker.h"
+#include "vehicle_table.h"
+
+
+// For convenience
+using std::string;
+using std::vector;
+using std::cout;
+using std::endl;
+
+typedef std::chrono::steady_clock Clock;
+
+
+// Keeps the optimiser from discarding benchmarked results
+volatile double sink = 0.0;
+
+
+// Nanoseconds per operation since start
+double ns_per_op(Clock::time_point start, long ops)
+{
+  std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  return elapsed.count() / ops;
+}
+
+
+void report(const string &name, double ns)
+{
+  cout << "  " << name;
+  for (size_t i = name.size(); i < 48; i++)
+  {
+    cout << ' ';
+  }
+  cout << ns << " ns/op" << endl;
+}
+
+
+// Heap allocation counter, incremented by the global operator new below
+long allocations = 0;
+
+
+void *operator new(size_t size)
+{
+  allocations++;
+  void *p = malloc(size);
+  if (p == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+
+// Map arrays copied into vectors for the vector-based helpers
+class MapVectors
+{
+  public:
+    vector<double> x;
+    vector<double> y;
+    vector<double> s;
+    vector<double> arc_s;
+    MapVectors(const TrackMap &map);
+};
+
+
+MapVectors::MapVectors(const TrackMap &map)
+{
+  this->x.assign(map.x(), map.x() + map.size());
+  this->y.assign(map.y(), map.y() + map.size());
+  this->s.assign(map.s(), map.s() + map.size());
+  this->arc_s.assign(map.arc_s(), map.arc_s() + map.size() + 1);
+}
+
+
+// Frenet to Cartesian: scalar getXY against the batched getXYBatch
+void bench_getxy(const TrackMap &map)
+{
+  cout << "getXY, " << map.size() << " waypoints" << endl;
+  MapVectors vec(map);
+
+  const int n = 4096;
+  const int reps = 200;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist_s(0.0, map.max_s());
+  std::uniform_real_distribution<double> dist_d(0.0, 12.0);
+  vector<double> s(n), d(n), x(n), y(n);
+  for (int i = 0; i < n; i++)
+  {
+    s[i] = dist_s(gen);
+    d[i] = dist_d(gen);
+  }
+  vector<double> sorted_s = s;
+  std::sort(sorted_s.begin(), sorted_s.end());
+
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      vector<double> xy = getXY(s[i], d[i], vec.s, vec.x, vec.y);
+      sink += xy[0] + xy[1];
+    }
+  }
+  report("scalar getXY (random s)", ns_per_op(start, (long)n * reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    getXYBatch(s.data(), d.data(), x.data(), y.data(), n, map);
+    sink += x[r % n] + y[r % n];
+  }
+  report("getXYBatch (random s)", ns_per_op(start, (long)n * reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    getXYBatch(sorted_s.data(), d.data(), x.data(), y.data(), n, map);
+    sink += x[r % n] + y[r % n];
+  }
+  report("getXYBatch (sorted s)", ns_per_op(start, (long)n * reps));
+
+  // Check the batch against the scalar version
+  double max_err = 0.0;
+  for (int i = 0; i < n; i++)
+  {
+    vector<double> xy = getXY(sorted_s[i], d[i], vec.s, vec.x, vec.y);
+    max_err = std::max(max_err, distance(xy[0], xy[1], x[i], y[i]));
+  }
+  cout << "  max |batch - scalar| = " << max_err << " m" << endl;
+}
+
+
+// Vector-returning conversions against the value-type overloads, counting
+// heap allocations per conversion. Returns false if the value-type
+// overloads allocate.
+bool bench_value_api(const TrackMap &map)
+{
+  cout << "Value-type conversions" << endl;
+  MapVectors vec(map);
+
+  const int n = 4096;
+  const int reps = 100;
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> dist_s(1.0, map.max_s());
+  std::uniform_real_distribution<double> dist_d(0.0, 12.0);
+  vector<double> s(n), d(n);
+  for (int i = 0; i < n; i++)
+  {
+    s[i] = dist_s(gen);
+    d[i] = dist_d(gen);
+  }
+  const long ops = (long)n * reps;
+
+  long allocs = allocations;
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      vector<double> xy = getXY(s[i], d[i], vec.s, vec.x, vec.y);
+      vector<double> sd = getFrenet(xy[0], xy[1], 0.0, vec.x, vec.y, vec.arc_s, map.grid());
+      sink += sd[0] + sd[1];
+    }
+  }
+  double ns = ns_per_op(start, ops);
+  allocs = allocations - allocs;
+  report("vector getXY + getFrenet", ns);
+  cout << "    heap allocations per conversion pair: " << double(allocs) / ops << endl;
+
+  allocs = allocations;
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      Cartesian xy = getXY(s[i], d[i], map);
+      Frenet sd = getFrenet(xy.x, xy.y, 0.0, map);
+      sink += sd.s + sd.d;
+    }
+  }
+  ns = ns_per_op(start, ops);
+  allocs = allocations - allocs;
+  report("value getXY + getFrenet", ns);
+  cout << "    heap allocations per conversion pair: " << double(allocs) / ops << endl;
+  return allocs == 0;
+}
+
+
+// Checks the faster Frenet helpers against the ones they replace. Returns
+//   false on any mismatch.
+bool check_frenet(const TrackMap &map)
+{
+  cout << "Frenet conversion checks" << endl;
+  MapVectors vec(map);
+  const int n = map.size();
+
+  double x_min = map.x()[0], x_max = map.x()[0];
+  double y_min = map.y()[0], y_max = map.y()[0];
+  for (int i = 0; i < n; i++)
+  {
+    x_min = std::min(x_min, map.x()[i]);
+    x_max = std::max(x_max, map.x()[i]);
+    y_min = std::min(y_min, map.y()[i]);
+    y_max = std::max(y_max, map.y()[i]);
+  }
+
+  // Grid closest waypoint against the full scan, for points on the road and
+  //   anywhere around the map
+  const int points = 20000;
+  std::mt19937 gen(11);
+  std::uniform_real_distribution<double> dist_s(0.0, map.max_s());
+  std::uniform_real_distribution<double> dist_d(0.0, 12.0);
+  std::uniform_real_distribution<double> dist_x(x_min - 200, x_max + 200);
+  std::uniform_real_distribution<double> dist_y(y_min - 200, y_max + 200);
+  int grid_wrong = 0;
+  for (int k = 0; k < points; k++)
+  {
+    Cartesian xy = getXY(dist_s(gen), dist_d(gen), map);
+    grid_wrong += ClosestWaypoint(xy.x, xy.y, map.grid()) != ClosestWaypoint(xy.x, xy.y, vec.x, vec.y);
+
+    double x = dist_x(gen);
+    double y = dist_y(gen);
+    grid_wrong += ClosestWaypoint(x, y, map.grid()) != ClosestWaypoint(x, y, vec.x, vec.y);
+  }
+  cout << "  grid ClosestWaypoint mismatches: " << grid_wrong << endl;
+
+  // getFrenet() with the arc length table against the loop summing the
+  //   segments, bit for bit, for points on the road heading along it
+  int arc_wrong = 0;
+  int arc_hint = -1;
+  for (int k = 0; k < points; k++)
+  {
+    double s = dist_s(gen);
+    int wp = SegmentAt(s, map, arc_hint);
+    double theta = atan2(map.heading_sin()[wp], map.heading_cos()[wp]);
+    Cartesian xy = getXY(s, dist_d(gen), map);
+    arc_wrong += getFrenet(xy.x, xy.y, theta, vec.x, vec.y) !=
+                 getFrenet(xy.x, xy.y, theta, vec.x, vec.y, vec.arc_s);
+  }
+  cout << "  arc length table getFrenet mismatches: " << arc_wrong << endl;
+
+  // Hinted closest waypoint against the full scan, with hints up to 90
+  //   waypoints stale for points on the road and random hints for points
+  //   anywhere around the map
+  std::uniform_int_distribution<int> dist_stale(-90, 90);
+  std::uniform_int_distribution<int> dist_wp(0, n - 1);
+  int hint_wrong = 0;
+  for (int k = 0; k < points; k++)
+  {
+    Cartesian xy = getXY(dist_s(gen), dist_d(gen), map);
+    int closest = ClosestWaypoint(xy.x, xy.y, vec.x, vec.y);
+    int hint = (closest + dist_stale(gen) + n) % n;
+    int map_hint = hint;
+    hint_wrong += ClosestWaypoint(xy.x, xy.y, vec.x, vec.y, hint) != closest;
+    hint_wrong += ClosestWaypoint(xy.x, xy.y, map, map_hint) != closest;
+
+    double x = dist_x(gen);
+    double y = dist_y(gen);
+    closest = ClosestWaypoint(x, y, vec.x, vec.y);
+    hint = dist_wp(gen);
+    hint_wrong += ClosestWaypoint(x, y, vec.x, vec.y, hint) != closest;
+  }
+  cout << "  hinted ClosestWaypoint mismatches: " << hint_wrong << endl;
+
+  // A car driving over the start line, converted each frame with a hint
+  //   against without
+  int frenet_wrong = 0;
+  double xy_err = 0.0;
+  int frenet_hint = -1, map_frenet_hint = -1, xy_hint = -1;
+  for (double s = map.max_s() - 100; s < map.max_s() + 100; s += 0.37)
+  {
+    double s_wrapped = fmod(s, map.max_s());
+    int wp = SegmentAt(s_wrapped, map, xy_hint);
+    double theta = atan2(map.heading_sin()[wp], map.heading_cos()[wp]);
+    Cartesian xy = getXY(s_wrapped, 6.0, map);
+
+    vector<double> sd = getFrenet(xy.x, xy.y, theta, vec.x, vec.y, vec.arc_s);
+    vector<double> sd_hint = getFrenet(xy.x, xy.y, theta, vec.x, vec.y, vec.arc_s, frenet_hint);
+    Frenet map_sd = getFrenet(xy.x, xy.y, theta, map);
+    Frenet map_sd_hint = getFrenet(xy.x, xy.y, theta, map, map_frenet_hint);
+    frenet_wrong += sd != sd_hint;
+    frenet_wrong += map_sd.s != map_sd_hint.s || map_sd.d != map_sd_hint.d;
+
+    // s past max_s must wrap to the same point as the wrapped s
+    vector<double> xy_plain = getXY(s_wrapped, 6.0, vec.s, vec.x, vec.y);
+    vector<double> xy_warm = getXY(s, 6.0, vec.s, vec.x, vec.y, map.max_s(), xy_hint);
+    xy_err = std::max(xy_err, distance(xy_plain[0], xy_plain[1], xy_warm[0], xy_warm[1]));
+  }
+  cout << "  hinted getFrenet mismatches over the start line: " << frenet_wrong << endl;
+  cout << "  max |hinted - plain getXY| over the start line: " << xy_err << " m" << endl;
+
+  return grid_wrong == 0 && arc_wrong == 0 && hint_wrong == 0 && frenet_wrong == 0 &&
+         xy_err < 1e-9;
+}
+
+
+// Uniform-s lookups on the smooth track model
+void bench_track_model(const TrackMap &map)
+{
+  cout << "Track model" << endl;
+
+  Clock::time_point start = Clock::now();
+  TrackModel track(map);
+  report("build (fit + resample)", ns_per_op(start, 1));
+
+  const int n = 4096;
+  const int reps = 500;
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<double> dist_s(0.0, map.max_s());
+  std::uniform_real_distribution<double> dist_d(0.0, 12.0);
+  vector<double> s(n), d(n), x(n), y(n);
+  for (int i = 0; i < n; i++)
+  {
+    s[i] = dist_s(gen);
+    d[i] = dist_d(gen);
+  }
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      Cartesian xy = getXY(s[i], d[i], map);
+      sink += xy.x + xy.y;
+    }
+  }
+  report("waypoint getXY (random s)", ns_per_op(start, (long)n * reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    track.getXY(s.data(), d.data(), x.data(), y.data(), n);
+    sink += x[r % n] + y[r % n];
+  }
+  report("TrackModel::getXY (random s)", ns_per_op(start, (long)n * reps));
+
+  // Project the points back, with hints a few metres off like last frame's s
+  std::uniform_real_distribution<double> dist_hint(-5.0, 5.0);
+  vector<double> hints(n), s_out(n), d_out(n);
+  for (int i = 0; i < n; i++)
+  {
+    hints[i] = s[i] + dist_hint(gen);
+  }
+
+  start = Clock::now();
+  for (int r = 0; r < reps / 10; r++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      Frenet sd = getFrenet(x[i], y[i], 0.0, map);
+      sink += sd.s + sd.d;
+    }
+  }
+  report("waypoint getFrenet", ns_per_op(start, (long)n * (reps / 10)));
+
+  long iterations = 0;
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    s_out = hints;
+    iterations += track.getFrenet(x.data(), y.data(), s_out.data(), d_out.data(), n);
+    sink += s_out[r % n] + d_out[r % n];
+  }
+  report("TrackModel::getFrenet (hint +-5 m)", ns_per_op(start, (long)n * reps));
+  cout << "    Newton iterations per point: " << double(iterations) / ((long)n * reps) << endl;
+
+  double max_err_s = 0.0;
+  double max_err_d = 0.0;
+  for (int i = 0; i < n; i++)
+  {
+    double err_s = fabs(s_out[i] - s[i]);
+    max_err_s = std::max(max_err_s, std::min(err_s, map.max_s() - err_s));
+    max_err_d = std::max(max_err_d, fabs(d_out[i] - d[i]));
+  }
+  cout << "    max round trip error: s " << max_err_s << " m, d " << max_err_d << " m" << endl;
+}
+
+
+// Band matrix with LU decomposition, the general solver tk::spline used for
+//   its tridiagonal system before the Thomas solver; kept as the baseline
+class BandMatrix
+{
+  public:
+    BandMatrix(int dim, int n_u, int n_l);
+    double &operator()(int i, int j);
+    void lu_solve(const double *b, double *x);
+
+  private:
+    std::vector<double, AlignedAllocator<double> > data_;
+    int dim_, upper_, lower_, stride_;
+    double &saved_diag(int i) { return data_[(upper_ + 1) * stride_ + i]; }
+};
+
+
+BandMatrix::BandMatrix(int dim, int n_u, int n_l)
+  : dim_(dim), upper_(n_u), lower_(n_l), stride_((dim + 7) / 8 * 8)
+{
+  // every band padded to whole cache lines, the saved diagonal after the
+  // diagonal and upper bands, then the lower bands
+  data_.assign((n_u + 1 + n_l + 1) * stride_, 0.0);
+}
+
+
+double &BandMatrix::operator()(int i, int j)
+{
+  int k = j - i;
+  if (k >= 0)
+  {
+    return data_[k * stride_ + i];
+  }
+  return data_[(upper_ + 1 - k) * stride_ + i];
+}
+
+
+// LU decomposition, then Ly = b and Rx = y in place
+void BandMatrix::lu_solve(const double *b, double *x)
+{
+  BandMatrix &A = *this;
+  for (int i = 0; i < dim_; i++)
+  {
+    saved_diag(i) = 1.0 / A(i, i);
+    int j_max = std::min(dim_ - 1, i + upper_);
+    for (int j = std::max(0, i - lower_); j <= j_max; j++)
+    {
+      A(i, j) *= saved_diag(i);
+    }
+    A(i, i) = 1.0;
+  }
+  for (int k = 0; k < dim_; k++)
+  {
+    int i_max = std::min(dim_ - 1, k + lower_);
+    for (int i = k + 1; i <= i_max; i++)
+    {
+      double f = -A(i, k) / A(k, k);
+      A(i, k) = -f;
+      int j_max = std::min(dim_ - 1, k + upper_);
+      for (int j = k + 1; j <= j_max; j++)
+      {
+        A(i, j) += f * A(k, j);
+      }
+    }
+  }
+
+  for (int i = 0; i < dim_; i++)
+  {
+    double sum = 0.0;
+    for (int j = std::max(0, i - lower_); j < i; j++)
+    {
+      sum += A(i, j) * x[j];
+    }
+    x[i] = b[i] * saved_diag(i) - sum;
+  }
+  for (int i = dim_ - 1; i >= 0; i--)
+  {
+    double sum = 0.0;
+    int j_stop = std::min(dim_ - 1, i + upper_);
+    for (int j = i + 1; j <= j_stop; j++)
+    {
+      sum += A(i, j) * x[j];
+    }
+    x[i] = (x[i] - sum) / A(i, i);
+  }
+}
+
+
+// Solving the spline's tridiagonal system: the general band LU decomposition
+//   used before against the dedicated Thomas solver. Returns false if the
+//   Thomas solver allocates.
+bool bench_spline_fit()
+{
+  cout << "Spline fit" << endl;
+
+  bool no_allocs = true;
+  const int sizes[] = {5, 50, 5000};
+  std::mt19937 gen(4);
+  std::uniform_real_distribution<double> dist_h(0.5, 2.0);
+  std::uniform_real_distribution<double> dist_y(-10.0, 10.0);
+  for (int k = 0; k < 3; k++)
+  {
+    const int n = sizes[k];
+    const int reps = 2000000 / n;
+    vector<double> x(n), y(n);
+    x[0] = 0.0;
+    y[0] = dist_y(gen);
+    for (int i = 1; i < n; i++)
+    {
+      x[i] = x[i - 1] + dist_h(gen);
+      y[i] = dist_y(gen);
+    }
+
+    // natural spline system, as set up by spline::set_points()
+    vector<double> sub(n, 0.0), diag(n), sup(n, 0.0), rhs(n);
+    for (int i = 1; i < n - 1; i++)
+    {
+      sub[i] = 1.0 / 3.0 * (x[i] - x[i - 1]);
+      diag[i] = 2.0 / 3.0 * (x[i + 1] - x[i - 1]);
+      sup[i] = 1.0 / 3.0 * (x[i + 1] - x[i]);
+      rhs[i] = (y[i + 1] - y[i]) / (x[i + 1] - x[i]) - (y[i] - y[i - 1]) / (x[i] - x[i - 1]);
+    }
+    diag[0] = 2.0;
+    diag[n - 1] = 2.0;
+    rhs[0] = 0.0;
+    rhs[n - 1] = 0.0;
+
+    std::ostringstream label;
+    label << "n=" << n << " ";
+
+    vector<double> b(n), scratch(3 * n);
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      BandMatrix A(n, 1, 1);
+      for (int i = 0; i < n; i++)
+      {
+        A(i, i) = diag[i];
+        if (i > 0) A(i, i - 1) = sub[i];
+        if (i < n - 1) A(i, i + 1) = sup[i];
+      }
+      A.lu_solve(rhs.data(), b.data());
+      sink += b[r % n];
+    }
+    report(label.str() + "band LU solve", ns_per_op(start, reps));
+
+    long allocs = allocations;
+    start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      b = rhs;
+      tk::solve_tridiagonal(sub.data(), diag.data(), sup.data(), b.data(), scratch.data(), n);
+      sink += b[r % n];
+    }
+    double ns = ns_per_op(start, reps);
+    allocs = allocations - allocs;
+    report(label.str() + "Thomas solve", ns);
+    cout << "    heap allocations per solve: " << double(allocs) / reps << endl;
+    no_allocs = no_allocs && allocs == 0;
+
+    start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      b = rhs;
+      tk::solve_cyclic_tridiagonal(sub.data(), diag.data(), sup.data(), b.data(), scratch.data(), n);
+      sink += b[r % n];
+    }
+    report(label.str() + "cyclic (Sherman-Morrison) solve", ns_per_op(start, reps));
+
+    tk::spline spline;
+    start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      spline.set_points(x, y);
+      sink += spline(x[r % n]);
+    }
+    report(label.str() + "spline::set_points", ns_per_op(start, reps));
+  }
+  return no_allocs;
+}
+
+
+// Fitting and sampling the 5 anchor trajectory spline of every frame.
+//   Returns false if fixed_spline allocates or differs from spline.
+bool bench_fixed_spline()
+{
+  cout << "Trajectory spline (5 anchors)" << endl;
+
+  // anchors as in main.cpp, in the car frame: two behind the car, three
+  //   at 30, 60 and 90 m ahead
+  std::mt19937 gen(5);
+  std::uniform_real_distribution<double> dist_y(-4.0, 4.0);
+  const int sets = 256;
+  vector<std::array<double, 5> > xs(sets), ys(sets);
+  for (int k = 0; k < sets; k++)
+  {
+    double x[5] = {-1.0, 0.0, 30.0, 60.0, 90.0};
+    for (int i = 0; i < 5; i++)
+    {
+      xs[k][i] = x[i];
+      ys[k][i] = (i < 2) ? 0.01 * dist_y(gen) : dist_y(gen);
+    }
+  }
+
+  const int reps = 2000;
+  const int samples = 50;
+  double max_diff = 0.0;
+  long allocs = allocations;
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    const std::array<double, 5> &x = xs[r % sets];
+    const std::array<double, 5> &y = ys[r % sets];
+    tk::spline s;
+    s.set_points(vector<double>(x.begin(), x.end()), vector<double>(y.begin(), y.end()));
+    for (int i = 1; i <= samples; i++)
+    {
+      sink += s(0.6 * i);
+    }
+  }
+  double ns = ns_per_op(start, reps);
+  allocs = allocations - allocs;
+  report("spline fit + 50 samples", ns);
+  cout << "    heap allocations per fit: " << double(allocs) / reps << endl;
+
+  allocs = allocations;
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    tk::fixed_spline<5> s;
+    s.set_points(xs[r % sets], ys[r % sets]);
+    for (int i = 1; i <= samples; i++)
+    {
+      sink += s(0.6 * i);
+    }
+  }
+  ns = ns_per_op(start, reps);
+  allocs = allocations - allocs;
+  report("fixed_spline<5> fit + 50 samples", ns);
+  cout << "    heap allocations per fit: " << double(allocs) / reps << endl;
+  long fixed_allocs = allocs;
+
+  // cubic and linear fits, extrapolated past both ends
+  double max_linear_diff = 0.0;
+  for (int k = 0; k < sets; k++)
+  {
+    vector<double> x(xs[k].begin(), xs[k].end());
+    vector<double> y(ys[k].begin(), ys[k].end());
+    tk::spline s, s_linear;
+    s.set_points(x, y);
+    s_linear.set_points(x, y, false);
+    tk::fixed_spline<5> f, f_linear;
+    f.set_points(xs[k], ys[k]);
+    f_linear.set_points(xs[k], ys[k], false);
+    for (double t = -5.0; t < 100.0; t += 0.25)
+    {
+      max_diff = std::max(max_diff, fabs(s(t) - f(t)));
+      max_linear_diff = std::max(max_linear_diff, fabs(s_linear(t) - f_linear(t)));
+    }
+  }
+  cout << "    max difference to spline: " << max_diff << ", linear: " << max_linear_diff << endl;
+  return fixed_allocs == 0 && max_diff < 1e-9 && max_linear_diff < 1e-9;
+}
+
+
+// Sampling a spline point by point against the batch evaluator. Returns
+//   false if the two differ.
+bool bench_spline_eval()
+{
+  cout << "Spline evaluation" << endl;
+
+  const int points = 200;
+  std::mt19937 gen(6);
+  std::uniform_real_distribution<double> dist_h(0.5, 2.0);
+  std::uniform_real_distribution<double> dist_y(-10.0, 10.0);
+  vector<double> px(points), py(points);
+  px[0] = 0.0;
+  py[0] = dist_y(gen);
+  for (int i = 1; i < points; i++)
+  {
+    px[i] = px[i - 1] + dist_h(gen);
+    py[i] = dist_y(gen);
+  }
+  tk::spline s;
+  s.set_points(px, py);
+
+  // increasing x like the trajectory samples, and the same x shuffled
+  const int n = 4096;
+  const int reps = 500;
+  vector<double> sorted(n), shuffled(n), ys(n), dys(n), ddys(n), dddys(n);
+  for (int i = 0; i < n; i++)
+  {
+    sorted[i] = -5.0 + (px[points - 1] + 10.0) * i / n;
+  }
+  shuffled = sorted;
+  std::shuffle(shuffled.begin(), shuffled.end(), gen);
+
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      ys[i] = s(sorted[i]);
+    }
+    sink += ys[r % n];
+  }
+  report("operator() (increasing x)", ns_per_op(start, (long)n * reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    s.eval_batch(sorted.data(), ys.data(), n);
+    sink += ys[r % n];
+  }
+  report("eval_batch (increasing x)", ns_per_op(start, (long)n * reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      ys[i] = s(shuffled[i]);
+    }
+    sink += ys[r % n];
+  }
+  report("operator() (random x)", ns_per_op(start, (long)n * reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    s.eval_batch(shuffled.data(), ys.data(), n);
+    sink += ys[r % n];
+  }
+  report("eval_batch (random x)", ns_per_op(start, (long)n * reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      ys[i] = s(sorted[i]);
+      dys[i] = s.deriv(1, sorted[i]);
+      ddys[i] = s.deriv(2, sorted[i]);
+      dddys[i] = s.deriv(3, sorted[i]);
+    }
+    sink += ys[r % n] + dddys[r % n];
+  }
+  report("operator() + deriv(1..3)", ns_per_op(start, (long)n * reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    s.eval_batch(sorted.data(), ys.data(), dys.data(), ddys.data(), dddys.data(), n);
+    sink += ys[r % n] + dddys[r % n];
+  }
+  report("eval_batch with derivatives", ns_per_op(start, (long)n * reps));
+
+  // both orders, so the cursor is checked when it moves forward and back
+  double max_diff = 0.0;
+  for (int order = 0; order < 2; order++)
+  {
+    const vector<double> &xs = (order == 0) ? sorted : shuffled;
+    s.eval_batch(xs.data(), ys.data(), dys.data(), ddys.data(), dddys.data(), n);
+    for (int i = 0; i < n; i++)
+    {
+      double x = xs[i];
+      max_diff = std::max(max_diff, fabs(ys[i] - s(x)));
+      max_diff = std::max(max_diff, fabs(dys[i] - s.deriv(1, x)));
+      max_diff = std::max(max_diff, fabs(ddys[i] - s.deriv(2, x)));
+      max_diff = std::max(max_diff, fabs(dddys[i] - s.deriv(3, x)));
+    }
+  }
+  cout << "    max difference to operator()/deriv(): " << max_diff << endl;
+  return max_diff < 1e-9;
+}
+
+
+// Building the 50 point trajectory: y(x) in the car frame with every point
+//   rotated back, against the parametric spline sampled in world coordinates
+void bench_trajectory_path(const TrackMap &map)
+{
+  cout << "Trajectory path (5 anchors, 50 points)" << endl;
+
+  const int sets = 256;
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> dist_s(0.0, map.max_s());
+  vector<std::array<double, 5> > xs(sets), ys(sets);
+  for (int k = 0; k < sets; k++)
+  {
+    double s = dist_s(gen);
+    double anchor_s[5] = {s - 0.8, s, s + 30, s + 60, s + 90};
+    for (int i = 0; i < 5; i++)
+    {
+      Cartesian xy = getXY(anchor_s[i], 6.0, map);
+      xs[k][i] = xy.x;
+      ys[k][i] = xy.y;
+    }
+  }
+
+  const int reps = 20000;
+  const int points = 50;
+  const double dist_inc = 0.4;
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    const std::array<double, 5> &x = xs[r % sets];
+    const std::array<double, 5> &y = ys[r % sets];
+    double ref_x = x[1];
+    double ref_y = y[1];
+    double ref_yaw = atan2(y[1] - y[0], x[1] - x[0]);
+    std::array<double, 5> local_x, local_y;
+    for (int i = 0; i < 5; i++)
+    {
+      double shift_x = x[i] - ref_x;
+      double shift_y = y[i] - ref_y;
+      local_x[i] = shift_x * cos(0 - ref_yaw) - shift_y * sin(0 - ref_yaw);
+      local_y[i] = shift_x * sin(0 - ref_yaw) + shift_y * cos(0 - ref_yaw);
+    }
+    tk::fixed_spline<5> s;
+    s.set_points(local_x, local_y);
+    double target_x = 30.0;
+    double target_y = s(target_x);
+    double target_dist = sqrt(target_x * target_x + target_y * target_y);
+    double x_add_on = 0;
+    for (int i = 1; i <= points; i++)
+    {
+      double N = target_dist / dist_inc;
+      double x_point = x_add_on + target_x / N;
+      double y_point = s(x_point);
+      x_add_on = x_point;
+      sink += ref_x + x_point * cos(ref_yaw) - y_point * sin(ref_yaw);
+      sink += ref_y + x_point * sin(ref_yaw) + y_point * cos(ref_yaw);
+    }
+  }
+  report("car frame y(x) + rotations", ns_per_op(start, reps));
+
+  tk::spline2d path;
+  double path_t[points], path_x[points], path_y[points];
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    path.set_points(xs[r % sets].data(), ys[r % sets].data(), 5);
+    for (int i = 0; i < points; i++)
+    {
+      path_t[i] = path.param(1) + (i + 1) * dist_inc;
+    }
+    path.eval_batch(path_t, path_x, path_y, points);
+    sink += path_x[r % points] + path_y[r % points];
+  }
+  report("spline2d in world coordinates", ns_per_op(start, reps));
+}
+
+
+// Speed error of stepping the trajectory by chord parameter against
+//   stepping by arc length, and the cost of the arc length table
+void bench_arc_length(const TrackMap &map)
+{
+  cout << "Arc length sampling (5 anchors, 50 points)" << endl;
+
+  // anchors on a lane change, where the path bends the most
+  const int sets = 256;
+  std::mt19937 gen(8);
+  std::uniform_real_distribution<double> dist_s(0.0, map.max_s());
+  vector<std::array<double, 5> > xs(sets), ys(sets);
+  for (int k = 0; k < sets; k++)
+  {
+    double s = dist_s(gen);
+    double anchor_s[5] = {s - 0.8, s, s + 30, s + 60, s + 90};
+    double anchor_d[5] = {2.0, 2.0, 6.0, 10.0, 10.0};
+    for (int i = 0; i < 5; i++)
+    {
+      Cartesian xy = getXY(anchor_s[i], anchor_d[i], map);
+      xs[k][i] = xy.x;
+      ys[k][i] = xy.y;
+    }
+  }
+
+  const int points = 50;
+  const double dist_inc = 0.44;
+  tk::spline2d path;
+  double path_s[points], path_t[points], path_x[points], path_y[points];
+
+  double max_err_chord = 0.0;
+  double max_err_arc = 0.0;
+  for (int k = 0; k < sets; k++)
+  {
+    path.set_points(xs[k].data(), ys[k].data(), 5);
+    path.build_arc_length();
+    double start_s = path.arc_length(path.param(1));
+    for (int i = 0; i < points; i++)
+    {
+      path_t[i] = path.param(1) + (i + 1) * dist_inc;
+      path_s[i] = start_s + (i + 1) * dist_inc;
+    }
+    path.eval_batch(path_t, path_x, path_y, points);
+    for (int i = 0; i < points; i++)
+    {
+      max_err_chord = std::max(max_err_chord, fabs(path.arc_length(path_t[i]) - path_s[i]));
+    }
+    path.t_at_arc_length(path_s, path_t, points);
+    for (int i = 0; i < points; i++)
+    {
+      max_err_arc = std::max(max_err_arc, fabs(path.arc_length(path_t[i]) - path_s[i]));
+    }
+  }
+  cout << "    max distance error stepping by chord parameter: " << max_err_chord << " m" << endl;
+  cout << "    max distance error stepping by arc length: " << max_err_arc << " m" << endl;
+
+  const int reps = 20000;
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    path.set_points(xs[r % sets].data(), ys[r % sets].data(), 5);
+    path.build_arc_length();
+    sink += path.arc_length();
+  }
+  report("fit + build_arc_length", ns_per_op(start, reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    for (int i = 0; i < points; i++)
+    {
+      path_s[i] = (r % 7) + (i + 1) * dist_inc;
+    }
+    path.t_at_arc_length(path_s, path_t, points);
+    sink += path_t[r % points];
+  }
+  report("t_at_arc_length per point", ns_per_op(start, (long)reps * points));
+}
+
+
+// Refitting splines in place and borrowing them from a pool, against a new
+//   spline per fit. Returns false if a warm fit allocates or a refit
+//   differs from a new fit.
+bool bench_spline_reuse()
+{
+  cout << "Spline reuse" << endl;
+
+  const int sets = 64;
+  const int lattice = 16;
+  std::mt19937 gen(9);
+  std::uniform_real_distribution<double> dist_y(-4.0, 4.0);
+  vector<std::array<double, 5> > xs(sets), ys(sets);
+  for (int k = 0; k < sets; k++)
+  {
+    double x[5] = {-1.0, 0.0, 30.0, 60.0, 90.0};
+    for (int i = 0; i < 5; i++)
+    {
+      xs[k][i] = x[i];
+      ys[k][i] = dist_y(gen);
+    }
+  }
+
+  const int reps = 20000;
+  long allocs = allocations;
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    tk::spline s;
+    s.set_points(vector<double>(xs[r % sets].begin(), xs[r % sets].end()),
+                 vector<double>(ys[r % sets].begin(), ys[r % sets].end()));
+    sink += s(45.0);
+  }
+  double ns = ns_per_op(start, reps);
+  allocs = allocations - allocs;
+  report("new spline per fit", ns);
+  cout << "    heap allocations per fit: " << double(allocs) / reps << endl;
+
+  // warm the reused objects with one fit, then count
+  tk::spline s;
+  s.refit(xs[0].data(), ys[0].data(), 5);
+  allocs = allocations;
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    s.refit(xs[r % sets].data(), ys[r % sets].data(), 5);
+    sink += s(45.0);
+  }
+  ns = ns_per_op(start, reps);
+  long refit_allocs = allocations - allocs;
+  report("spline::refit", ns);
+  cout << "    heap allocations per fit: " << double(refit_allocs) / reps << endl;
+
+  tk::spline2d path;
+  double path_s[50], path_t[50], path_x[50], path_y[50];
+  for (int i = 0; i < 50; i++)
+  {
+    path_s[i] = 1.0 + 0.4 * i;
+  }
+  path.refit(xs[0].data(), ys[0].data(), 5);
+  path.build_arc_length();
+  allocs = allocations;
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    path.refit(xs[r % sets].data(), ys[r % sets].data(), 5);
+    path.build_arc_length();
+    path.t_at_arc_length(path_s, path_t, 50);
+    path.eval_batch(path_t, path_x, path_y, 50);
+    sink += path_x[r % 50];
+  }
+  ns = ns_per_op(start, reps);
+  long path_allocs = allocations - allocs;
+  report("spline2d refit + arc length + 50 samples", ns);
+  cout << "    heap allocations per path: " << double(path_allocs) / reps << endl;
+
+  // a lattice of candidate splines per frame, all borrowed from the pool
+  tk::spline_pool<tk::spline> pool(lattice, 5);
+  allocs = allocations;
+  start = Clock::now();
+  for (int r = 0; r < reps / lattice; r++)
+  {
+    for (int k = 0; k < lattice; k++)
+    {
+      tk::spline_pool<tk::spline>::borrowed candidate(pool);
+      candidate->refit(xs[(r + k) % sets].data(), ys[(r + k) % sets].data(), 5);
+      sink += (*candidate)(45.0);
+    }
+  }
+  ns = ns_per_op(start, (long)(reps / lattice) * lattice);
+  long pool_allocs = allocations - allocs;
+  report("spline_pool borrow + refit", ns);
+  cout << "    heap allocations per fit: " << double(pool_allocs) / reps << endl;
+
+  bool ok = (refit_allocs == 0 && path_allocs == 0 && pool_allocs == 0);
+  cout << "    steady state allocation check: " << (ok ? "passed" : "FAILED") << endl;
+
+  // a refit must not keep anything of the fit before it: linear after a
+  //   clamped cubic fit, against a new spline
+  double reuse_diff = 0.0;
+  tk::spline reused;
+  reused.set_boundary(tk::spline::first_deriv, 1.0, tk::spline::second_deriv, 6.0);
+  for (int k = 0; k < sets; k++)
+  {
+    reused.refit(xs[k].data(), ys[k].data(), 5);
+    reused.refit(xs[k].data(), ys[k].data(), 5, false);
+    tk::spline fresh;
+    fresh.set_boundary(tk::spline::first_deriv, 1.0, tk::spline::second_deriv, 6.0);
+    fresh.refit(xs[k].data(), ys[k].data(), 5, false);
+    for (double x = -5.0; x < 100.0; x += 0.25)
+    {
+      reuse_diff = std::max(reuse_diff, fabs(reused(x) - fresh(x)));
+    }
+  }
+  cout << "    max difference of a linear refit after a cubic fit: " << reuse_diff << endl;
+  return ok && reuse_diff == 0.0;
+}
+
+
+// Jerk minimising trajectory candidates, solving each 3x3 system against
+//   using the cached inverse of its horizon. Returns false if the cached
+//   solutions miss the end conditions or differ from the direct ones.
+bool bench_jmt()
+{
+  cout << "JMT candidates" << endl;
+
+  JMTSolver solver(1.0, 5.0, 0.1);
+  const int n = 100000;
+  std::mt19937 gen(10);
+  std::uniform_real_distribution<double> dist_s(20.0, 120.0);
+  std::uniform_real_distribution<double> dist_v(0.0, 22.0);
+  std::uniform_int_distribution<int> dist_k(0, solver.size() - 1);
+  MotionState start = {0.0, 15.0, 0.5};
+  vector<MotionState> end(n);
+  vector<int> horizon(n);
+  for (int i = 0; i < n; i++)
+  {
+    end[i].p = dist_s(gen);
+    end[i].v = dist_v(gen);
+    end[i].a = 0.0;
+    horizon[i] = dist_k(gen);
+  }
+  vector<Quintic> direct(n), cached(n);
+
+  Clock::time_point start_time = Clock::now();
+  for (int i = 0; i < n; i++)
+  {
+    direct[i] = solveJMT(start, end[i], solver.horizon(horizon[i]));
+  }
+  sink += direct[n / 2].c[5];
+  report("solveJMT (3x3 inverse per candidate)", ns_per_op(start_time, n));
+
+  start_time = Clock::now();
+  for (int i = 0; i < n; i++)
+  {
+    cached[i] = solver.solve_index(start, end[i], horizon[i]);
+  }
+  sink += cached[n / 2].c[5];
+  double ns = ns_per_op(start_time, n);
+  report("JMTSolver (cached inverse)", ns);
+  cout << "    frame of 1e5 candidates: " << ns * n / 1e6 << " ms" << endl;
+
+  // both must meet the end conditions
+  double max_err = 0.0;
+  for (int i = 0; i < n; i++)
+  {
+    const Quintic &q = cached[i];
+    max_err = std::max(max_err, fabs(q.position(q.T) - end[i].p));
+    max_err = std::max(max_err, fabs(q.velocity(q.T) - end[i].v));
+    max_err = std::max(max_err, fabs(q.acceleration(q.T) - end[i].a));
+    for (int c = 0; c < 6; c++)
+    {
+      max_err = std::max(max_err, fabs(q.c[c] - direct[i].c[c]));
+    }
+  }
+  cout << "    max end condition / coefficient error: " << max_err << endl;
+  return max_err < 1e-9;
+}
+
+
+// Trajectory fits in steady lane keeping through the spline cache, with
+//   the deviation of the cached paths from exact fits. Returns false if a
+//   cached path strays past twice the anchor error bound.
+bool bench_spline_cache(const TrackMap &map)
+{
+  cout << "Spline cache (lane keeping at 20 m/s)" << endl;
+
+  // ego frame anchors of successive frames as the planner builds them: the
+  //   end of the previous path, which advances 0.4 m per frame, and lane
+  //   centre points 30, 60 and 90 m ahead of the car, with the path
+  //   clamped to start along the x axis
+  const int frames = 20000;
+  const int points = 50;
+  const double dist_inc = 0.4;
+  vector<std::array<double, 4> > ego_x(frames), ego_y(frames);
+  for (int f = 0; f < frames; f++)
+  {
+    double car_s = fmod(100.0 + f * dist_inc, map.max_s());
+    double anchor_s[4] = {car_s + 19.6, car_s + 30, car_s + 60, car_s + 90};
+    double x[4], y[4];
+    for (int i = 0; i < 4; i++)
+    {
+      Cartesian xy = getXY(anchor_s[i], 6.0, map);
+      x[i] = xy.x;
+      y[i] = xy.y;
+    }
+    Cartesian prev = getXY(car_s + 19.2, 6.0, map);
+    double yaw = atan2(y[0] - prev.y, x[0] - prev.x);
+    for (int i = 0; i < 4; i++)
+    {
+      double shift_x = x[i] - x[0];
+      double shift_y = y[i] - y[0];
+      ego_x[f][i] = shift_x * cos(yaw) + shift_y * sin(yaw);
+      ego_y[f][i] = -shift_x * sin(yaw) + shift_y * cos(yaw);
+    }
+  }
+
+  double path_s[points], path_t[points], path_x[points], path_y[points];
+  for (int i = 0; i < points; i++)
+  {
+    path_s[i] = (i + 1) * dist_inc;
+  }
+
+  tk::spline2d exact;
+  exact.set_boundary(tk::spline::first_deriv, 1.0, 0.0, tk::spline::second_deriv, 0.0, 0.0);
+  Clock::time_point start = Clock::now();
+  for (int f = 0; f < frames; f++)
+  {
+    exact.refit(ego_x[f].data(), ego_y[f].data(), 4);
+    exact.build_arc_length();
+    sink += exact.arc_length();
+  }
+  report("spline2d refit + arc length", ns_per_op(start, frames));
+
+  bool within = true;
+  const double quanta[3] = {0.01, 0.05, 0.2};
+  for (int q = 0; q < 3; q++)
+  {
+    SplineCache cache(64, quanta[q]);
+    cache.set_boundary(tk::spline::first_deriv, 1.0, 0.0, tk::spline::second_deriv, 0.0, 0.0);
+    std::ostringstream label;
+    label << "SplineCache::fit (quantum " << quanta[q] << " m)";
+    start = Clock::now();
+    for (int f = 0; f < frames; f++)
+    {
+      const tk::spline2d &path = cache.fit(ego_x[f].data(), ego_y[f].data(), 4);
+      sink += path.arc_length();
+    }
+    report(label.str(), ns_per_op(start, frames));
+    cout << "    hit rate: " << double(cache.hits()) / frames << endl;
+
+    // deviation of the cached path from the exact one, sampled as the
+    //   planner does, against the anchor error
+    double max_err = 0.0;
+    for (int f = 0; f < frames; f++)
+    {
+      const tk::spline2d &path = cache.fit(ego_x[f].data(), ego_y[f].data(), 4);
+      exact.refit(ego_x[f].data(), ego_y[f].data(), 4);
+      exact.build_arc_length();
+      path.t_at_arc_length(path_s, path_t, points);
+      path.eval_batch(path_t, path_x, path_y, points);
+      for (int i = 0; i < points; i++)
+      {
+        double x, y;
+        exact(exact.t_at_arc_length(path_s[i]), x, y);
+        max_err = std::max(max_err, sqrt((x - path_x[i]) * (x - path_x[i]) + (y - path_y[i]) * (y - path_y[i])));
+      }
+    }
+    cout << "    max path error: " << max_err << " m (anchor error bound "
+         << cache.max_anchor_error() << " m, "
+         << (max_err <= 2 * cache.max_anchor_error() ? "within" : "EXCEEDS") << " twice the bound)" << endl;
+    within = within && max_err <= 2 * cache.max_anchor_error();
+  }
+
+  // More anchors than a cache entry holds are fitted exactly, uncached
+  SplineCache cache;
+  const int many = SplineCache::MAX_ANCHORS + 4;
+  double many_x[many], many_y[many];
+  for (int i = 0; i < many; i++)
+  {
+    many_x[i] = 10.0 * i;
+    many_y[i] = 0.5 * sin(0.3 * i);
+  }
+  const tk::spline2d &path = cache.fit(many_x, many_y, many);
+  double x, y;
+  path(path.param(many - 1), x, y);
+  cout << "    " << many << " anchors: uncached fit ends at (" << x << ", " << y << ")" << endl;
+  bool exact_end = fabs(x - many_x[many - 1]) < 1e-9 && fabs(y - many_y[many - 1]) < 1e-9;
+  return within && exact_end;
+}
+
+
+// Fit cost of the boundary modes, each with its own solver. Returns false
+//   if a warm refit allocates or fixed_spline differs from spline in any
+//   mode.
+bool bench_spline_boundary()
+{
+  cout << "Spline boundary modes" << endl;
+
+  bool refit_ok = true;
+  bool fixed_ok = true;
+  const int sizes[] = {5, 50, 5000};
+  std::mt19937 gen(11);
+  std::uniform_real_distribution<double> dist_h(0.5, 2.0);
+  std::uniform_real_distribution<double> dist_y(-10.0, 10.0);
+  for (int k = 0; k < 3; k++)
+  {
+    const int n = sizes[k];
+    const int reps = 2000000 / n;
+    vector<double> x(n), y(n);
+    x[0] = 0.0;
+    y[0] = dist_y(gen);
+    for (int i = 1; i < n; i++)
+    {
+      x[i] = x[i - 1] + dist_h(gen);
+      y[i] = dist_y(gen);
+    }
+    y[n - 1] = y[0];
+
+    const tk::spline::bd_type modes[3] = {tk::spline::second_deriv, tk::spline::first_deriv, tk::spline::periodic};
+    const char *names[3] = {"natural", "clamped", "periodic"};
+    for (int m = 0; m < 3; m++)
+    {
+      tk::spline s;
+      s.set_boundary(modes[m], 0.0, modes[m], 0.0);
+      s.refit(x.data(), y.data(), n);
+      long allocs = allocations;
+      Clock::time_point start = Clock::now();
+      for (int r = 0; r < reps; r++)
+      {
+        s.refit(x.data(), y.data(), n);
+        sink += s(x[r % n]);
+      }
+      double ns = ns_per_op(start, reps);
+      allocs = allocations - allocs;
+      std::ostringstream label;
+      label << "n=" << n << " " << names[m] << " refit";
+      report(label.str(), ns);
+      if (allocs != 0)
+      {
+        cout << "    heap allocations per fit: " << double(allocs) / reps << endl;
+        refit_ok = false;
+      }
+
+      // fixed_spline supports the same modes, with periodic wrapping
+      if (n == 5)
+      {
+        tk::fixed_spline<5> f;
+        f.set_boundary(modes[m], 0.0, modes[m], 0.0);
+        f.set_points(x.data(), y.data());
+        double max_diff = 0.0;
+        for (double t = x[0] - 2.0; t < 2.0 * x[n - 1]; t += 0.1)
+        {
+          max_diff = std::max(max_diff, fabs(s(t) - f(t)));
+          max_diff = std::max(max_diff, fabs(s.deriv(1, t) - f.deriv(1, t)));
+        }
+        cout << "    fixed_spline<5> max difference to spline: " << max_diff << endl;
+        fixed_ok = fixed_ok && max_diff < 1e-9;
+      }
+    }
+  }
+  return refit_ok && fixed_ok;
+}
+
+
+// Reading the sensor fusion list: JSON lookups for every vehicle pair, as
+//   the lane change checks did, against one pass into the vehicle table.
+//   Returns false if refilling the table allocates.
+bool bench_vehicle_table()
+{
+  cout << "Vehicle table" << endl;
+
+  bool no_allocs = true;
+  const int counts[] = {12, 200};
+  std::mt19937 gen(12);
+  std::uniform_real_distribution<double> dist_s(0.0, 300.0);
+  std::uniform_real_distribution<double> dist_d(0.0, 12.0);
+  std::uniform_real_distribution<double> dist_v(10.0, 22.0);
+  for (int c = 0; c < 2; c++)
+  {
+    const int n = counts[c];
+    const int reps = 200000 / n;
+    nlohmann::json sensor_fusion = nlohmann::json::array();
+    for (int i = 0; i < n; i++)
+    {
+      double s = dist_s(gen);
+      sensor_fusion.push_back({i, 900.0 + s, 1100.0, dist_v(gen), 0.5, s, dist_d(gen)});
+    }
+    const double horizon = 30 * 0.02;
+    std::ostringstream label;
+    label << n << " vehicles ";
+
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      double sum = 0.0;
+      for (int i = 0; i < n; i++)
+      {
+        double vx = sensor_fusion[i][3];
+        double vy = sensor_fusion[i][4];
+        double s = sensor_fusion[i][5];
+        sum += s + horizon * sqrt(vx * vx + vy * vy);
+        for (int j = 0; j < n; j++)
+        {
+          double merge_s = sensor_fusion[j][5];
+          double merge_d = sensor_fusion[j][6];
+          sum += merge_s * merge_d;
+        }
+      }
+      sink += sum;
+    }
+    report(label.str() + "JSON per pair", ns_per_op(start, reps));
+
+    VehicleTable vehicles;
+    vehicles.assign(sensor_fusion, horizon);
+    long allocs = allocations;
+    start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      vehicles.assign(sensor_fusion, horizon);
+      double sum = 0.0;
+      for (int i = 0; i < n; i++)
+      {
+        sum += vehicles.future_s()[i];
+        for (int j = 0; j < n; j++)
+        {
+          sum += vehicles.s()[j] * vehicles.d()[j];
+        }
+      }
+      sink += sum;
+    }
+    double ns = ns_per_op(start, reps);
+    allocs = allocations - allocs;
+    report(label.str() + "VehicleTable", ns);
+    cout << "    heap allocations per frame: " << double(allocs) / reps << endl;
+    no_allocs = no_allocs && allocs == 0;
+  }
+  return no_allocs;
+}
+
+
+// Leader, follower and merge room of every lane, branching per vehicle as
+//   the Car checks did against the occupancy kernels; returns false when
+//   laneOccupancy() or the branching pass differ from the scalar path
+bool bench_lane_kernel(const TrackMap &map)
+{
+  cout << "Lane occupancy kernel" << endl;
+#if defined(LANE_KERNEL_AVX2)
+  if (laneKernelHasAvx2())
+  {
+    cout << "    vector path: AVX2 from " << LANE_KERNEL_MIN_VECTOR << " vehicles" << endl;
+  }
+  else
+  {
+    cout << "    vector path: none on this CPU, branching pass" << endl;
+  }
+#else
+  cout << "    vector path: not built, branching pass" << endl;
+#endif
+
+  const double max_s = map.max_s();
+  const double width = map.lane_width();
+  const int lanes = map.lane_count();
+  const int counts[] = {12, 50, 200, 2000};
+  std::mt19937 gen(14);
+  std::uniform_real_distribution<double> dist_s(0.0, max_s);
+  std::uniform_real_distribution<double> dist_d(0.0, lanes * width);
+  std::uniform_real_distribution<double> dist_v(10.0, 22.0);
+  const double merge_distance = 30.0;
+  const int frames = 256;
+  vector<double> ego_s(frames);
+  for (int f = 0; f < frames; f++)
+  {
+    ego_s[f] = dist_s(gen);
+  }
+  vector<LaneOccupancy> out(lanes), check(lanes);
+  int mismatches = 0;
+  for (int c = 0; c < 4; c++)
+  {
+    const int n = counts[c];
+    const int reps = 2000000 / n;
+    vector<double> s(n), d(n), v(n);
+    for (int i = 0; i < n; i++)
+    {
+      s[i] = dist_s(gen);
+      d[i] = dist_d(gen);
+      v[i] = dist_v(gen);
+    }
+    // a few cars on the lane lines and road edges, in no lane
+    for (int i = 0; i < n; i += 11)
+    {
+      d[i] = (i / 11 % (lanes + 1)) * width;
+    }
+    std::ostringstream label;
+    label << n << " vehicles ";
+
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      double ego = ego_s[r % frames];
+      int merge_mask = 0;
+      for (int lane = 0; lane < lanes; lane++)
+      {
+        double ahead = max_s;
+        double behind = max_s;
+        for (int i = 0; i < n; i++)
+        {
+          if (d[i] > lane * width && d[i] < (lane + 1) * width)
+          {
+            double gap = s[i] - ego;
+            if (gap < 0.0)
+            {
+              gap += max_s;
+            }
+            if (gap > 0.0)
+            {
+              if (gap < ahead)
+              {
+                ahead = gap;
+              }
+              if (max_s - gap < behind)
+              {
+                behind = max_s - gap;
+              }
+            }
+            else
+            {
+              behind = 0.0;
+            }
+          }
+        }
+        if (ahead >= merge_distance && behind >= merge_distance)
+        {
+          merge_mask |= 1 << lane;
+        }
+        sink += ahead + behind;
+      }
+      sink += merge_mask;
+    }
+    report(label.str() + "branching scan", ns_per_op(start, reps));
+
+    start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      sink += laneOccupancyScalar(s.data(), d.data(), v.data(), n, ego_s[r % frames], lanes,
+                                  width, max_s, merge_distance, out.data());
+      sink += out[0].leader_gap;
+    }
+    report(label.str() + "laneOccupancyScalar", ns_per_op(start, reps));
+
+    start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      sink += laneOccupancyScan(s.data(), d.data(), v.data(), n, ego_s[r % frames], lanes,
+                                width, max_s, merge_distance, out.data());
+      sink += out[0].leader_gap;
+    }
+    report(label.str() + "laneOccupancyScan", ns_per_op(start, reps));
+
+    start = Clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+      sink += laneOccupancy(s.data(), d.data(), v.data(), n, ego_s[r % frames], lanes, width,
+                            max_s, merge_distance, out.data());
+      sink += out[0].leader_gap;
+    }
+    report(label.str() + "laneOccupancy", ns_per_op(start, reps));
+
+    // laneOccupancy() and the branching pass against the scalar path on
+    //   every frame, bit for bit
+    int errors = 0;
+    for (int f = 0; f < frames; f++)
+    {
+      int check_mask = laneOccupancyScalar(s.data(), d.data(), v.data(), n, ego_s[f], lanes,
+                                           width, max_s, merge_distance, check.data());
+      for (int version = 0; version < 2; version++)
+      {
+        int mask = (version == 0)
+                       ? laneOccupancy(s.data(), d.data(), v.data(), n, ego_s[f], lanes, width,
+                                       max_s, merge_distance, out.data())
+                       : laneOccupancyScan(s.data(), d.data(), v.data(), n, ego_s[f], lanes,
+                                           width, max_s, merge_distance, out.data());
+        bool same = (mask == check_mask);
+        for (int lane = 0; lane < lanes; lane++)
+        {
+          same = same && out[lane].leader_gap == check[lane].leader_gap &&
+                 out[lane].leader_speed == check[lane].leader_speed &&
+                 out[lane].follower_gap == check[lane].follower_gap &&
+                 out[lane].follower_speed == check[lane].follower_speed;
+        }
+        errors += !same;
+      }
+    }
+    cout << "    frames differing from the scalar path: " << errors << endl;
+    mismatches += errors;
+  }
+  return mismatches == 0;
+}
+
+
+// Tracking vehicles across frames by ID, with the pooled tracker against a
+//   std::unordered_map of tracks, while vehicles leave and join the scene.
+//   Returns false if the warm tracker allocates.
+bool bench_tracker()
+{
+  cout << "Tracker" << endl;
+
+  const int n = 200;
+  const int frames = 20000;
+  std::mt19937 gen(15);
+  std::uniform_real_distribution<double> dist_s(0.0, 1000.0);
+  std::uniform_real_distribution<double> dist_d(0.0, 12.0);
+  std::uniform_real_distribution<double> dist_v(10.0, 22.0);
+  std::uniform_int_distribution<int> dist_row(0, n - 1);
+
+  // scene of n vehicles; every frame one leaves and a new ID takes its row
+  vector<int> ids(n);
+  vector<double> s(n), d(n), v(n);
+  for (int i = 0; i < n; i++)
+  {
+    ids[i] = i;
+    s[i] = dist_s(gen);
+    d[i] = dist_d(gen);
+    v[i] = dist_v(gen);
+  }
+  vector<int> leaving(frames);
+  for (int f = 0; f < frames; f++)
+  {
+    leaving[f] = dist_row(gen);
+  }
+  VehicleTable vehicles;
+
+  Tracker tracker;
+  std::unordered_map<int, Track> map_tracks;
+  long tracker_allocs = 0;
+  long map_allocs = 0;
+  double tracker_ns = 0.0;
+  double map_ns = 0.0;
+  int next_id = n;
+  for (int f = 0; f < frames; f++)
+  {
+    double time = f * 0.02;
+    int row = leaving[f];
+    ids[row] = next_id++;
+    vehicles.clear();
+    for (int i = 0; i < n; i++)
+    {
+      s[i] += v[i] * 0.02;
+      vehicles.push_back(ids[i], 0.0, 0.0, v[i], 0.0, s[i], d[i]);
+    }
+    bool warm = f >= frames / 10;
+
+    long allocs = allocations;
+    Clock::time_point start = Clock::now();
+    tracker.update(vehicles, time);
+    tracker_ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    if (warm)
+    {
+      tracker_allocs += allocations - allocs;
+    }
+
+    // the same with a node based map: look up or insert every ID, then drop stale tracks
+    allocs = allocations;
+    start = Clock::now();
+    for (int i = 0; i < n; i++)
+    {
+      Track &track = map_tracks[vehicles.id()[i]];
+      if (track.updates == 0)
+      {
+        track.id = vehicles.id()[i];
+        track.first_seen = time;
+      }
+      track.s = vehicles.s()[i];
+      track.d = vehicles.d()[i];
+      track.last_seen = time;
+      ++track.updates;
+    }
+    for (std::unordered_map<int, Track>::iterator it = map_tracks.begin(); it != map_tracks.end();)
+    {
+      if (time - it->second.last_seen > 1.0)
+      {
+        it = map_tracks.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+    map_ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    if (warm)
+    {
+      map_allocs += allocations - allocs;
+    }
+    sink += tracker.track(tracker.slot(row)).s;
+  }
+
+  report("Tracker update, 200 vehicles", tracker_ns / frames);
+  report("unordered_map update, 200 vehicles", map_ns / frames);
+  cout << "    heap allocations per frame: " << double(tracker_allocs) / (frames - frames / 10)
+       << " (unordered_map " << double(map_allocs) / (frames - frames / 10) << ")" << endl;
+  cout << "    live tracks: " << tracker.size() << " (unordered_map " << map_tracks.size() << ")"
+       << endl;
+  return tracker_allocs == 0;
+}
+
+
+// Kalman filtering and multi horizon prediction of 200 tracked vehicles at
+//   50 Hz, and its error 1 s ahead against extrapolating the telemetry at
+//   constant speed, for vehicles changing speed and lane. Returns false if
+//   a warm update allocates.
+bool bench_prediction()
+{
+  cout << "Prediction" << endl;
+
+  const int n = 200;
+  const int frames = 3000;
+  const double dt = 0.02;
+  const double lookahead = 1.0;
+  const int ahead = (int)(lookahead / dt + 0.5);
+  const double max_s = 6945.554;
+  std::mt19937 gen(16);
+  std::uniform_real_distribution<double> dist_s(0.0, max_s);
+  std::uniform_real_distribution<double> dist_v(12.0, 20.0);
+  std::uniform_real_distribution<double> dist_phase(0.0, 2.0 * pi());
+  std::normal_distribution<double> noise(0.0, 0.05);
+
+  // each vehicle speeds up and slows down by up to 2 m/s^2 and changes lane
+  //   every 8 s
+  vector<double> s0(n), v0(n), phase(n);
+  for (int i = 0; i < n; i++)
+  {
+    s0[i] = dist_s(gen);
+    v0[i] = dist_v(gen);
+    phase[i] = dist_phase(gen);
+  }
+  const double w = 0.5;
+  const double accel = 2.0;
+  // true s and d of vehicle i at time t
+  auto true_s = [&](int i, double t)
+  {
+    double s = s0[i] + v0[i] * t - accel / (w * w) * (sin(w * t + phase[i]) - sin(phase[i]))
+               + accel / w * cos(phase[i]) * t;
+    return fmod(s, max_s);
+  };
+  auto true_d = [&](int i, double t)
+  {
+    return 6.0 + 2.0 * tanh(4.0 * sin(2.0 * pi() * t / 16.0 + phase[i]));
+  };
+
+  Tracker tracker;
+  Predictor predictor(3, lookahead / 3);
+  VehicleTable vehicles;
+  // predictions made `ahead` frames before, to score against the truth
+  vector<double> kalman_s(frames * n), kalman_d(frames * n), speed_s(frames * n), speed_d(frames * n);
+  double update_ns = 0.0;
+  long allocs = 0;
+  for (int f = 0; f < frames; f++)
+  {
+    double t = f * dt;
+    vehicles.clear();
+    for (int i = 0; i < n; i++)
+    {
+      double s = true_s(i, t);
+      double v = (true_s(i, t + 0.001) - true_s(i, t - 0.001)) / 0.002;
+      if (fabs(v) > 100.0)
+      {
+        v = v0[i];
+      }
+      vehicles.push_back(i, 0.0, 0.0, v + noise(gen), 0.0, s + noise(gen), true_d(i, t) + noise(gen));
+    }
+    tracker.update(vehicles, t);
+
+    long a = allocations;
+    Clock::time_point start = Clock::now();
+    predictor.update(tracker, vehicles, t, max_s);
+    update_ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    if (f >= 10)
+    {
+      allocs += allocations - a;
+    }
+
+    const double *ps = predictor.predicted_s(predictor.horizons() - 1);
+    const double *pd = predictor.predicted_d(predictor.horizons() - 1);
+    for (int i = 0; i < n; i++)
+    {
+      kalman_s[f * n + i] = ps[i];
+      kalman_d[f * n + i] = pd[i];
+      speed_s[f * n + i] = vehicles.s()[i] + lookahead * vehicles.speed()[i];
+      speed_d[f * n + i] = vehicles.d()[i];
+    }
+  }
+
+  // RMS errors after the filters settle
+  double kalman_s_err = 0.0, kalman_d_err = 0.0, speed_s_err = 0.0, speed_d_err = 0.0;
+  long count = 0;
+  for (int f = 50; f + ahead < frames; f++)
+  {
+    double t = (f + ahead) * dt;
+    for (int i = 0; i < n; i++)
+    {
+      double s = true_s(i, t);
+      double d = true_d(i, t);
+      double es = kalman_s[f * n + i] - s;
+      double ec = speed_s[f * n + i] - s;
+      es -= max_s * floor(es / max_s + 0.5);
+      ec -= max_s * floor(ec / max_s + 0.5);
+      kalman_s_err += es * es;
+      speed_s_err += ec * ec;
+      kalman_d_err += (kalman_d[f * n + i] - d) * (kalman_d[f * n + i] - d);
+      speed_d_err += (speed_d[f * n + i] - d) * (speed_d[f * n + i] - d);
+      count++;
+    }
+  }
+
+  report("Predictor update, 200 vehicles", update_ns / frames);
+  cout << "    heap allocations per frame: " << double(allocs) / (frames - 10) << endl;
+  cout << "    RMS error " << lookahead << " s ahead, s: " << sqrt(kalman_s_err / count)
+       << " m (constant speed " << sqrt(speed_s_err / count) << " m), d: "
+       << sqrt(kalman_d_err / count) << " m (current d " << sqrt(speed_d_err / count) << " m)"
+       << endl;
+  return allocs == 0;
+}
+
+
+// Copy of a map file with one bit of the byte at offset flipped; true if the
+//   corrupted copy is still accepted by MappedMapFile::open
+bool corrupt_map_accepted(const string &bin_file, size_t offset, int bit)
+{
+  std::ifstream in(bin_file.c_str(), std::ifstream::binary);
+  vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  bytes[offset] ^= char(1 << bit);
+
+  string bad_file = bin_file + ".bad";
+  std::ofstream out(bad_file.c_str(), std::ofstream::binary);
+  out.write(bytes.data(), bytes.size());
+  out.close();
+
+  MappedMapFile mapped;
+  bool accepted = mapped.open(bad_file);
+  remove(bad_file.c_str());
+  return accepted;
+}
+
+
+// A map file written with the given header values and a valid checksum;
+//   true if it is accepted by MappedMapFile::open
+bool bad_header_map_accepted(const TrackMap &map, double max_s, uint32_t lane_count,
+                             double lane_width)
+{
+  const double *arrays[MAP_ARRAY_COUNT] = {map.x(),     map.y(),       map.s(),
+                                           map.dx(),    map.dy(),      map.arc_s(),
+                                           map.seg_len(), map.heading_cos(),
+                                           map.heading_sin()};
+  string bad_file = "benchmark_map.bad";
+  writeMapFile(bad_file, map.size(), max_s, lane_count, lane_width, arrays);
+
+  MappedMapFile mapped;
+  bool accepted = mapped.open(bad_file);
+  remove(bad_file.c_str());
+  return accepted;
+}
+
+
+// Parsing the CSV map against mapping the binary map
+bool bench_map_loading(const string &map_file, const TrackMap &map)
+{
+  cout << "Map loading" << endl;
+
+  string bin_file = "benchmark_map.bin";
+  if (!map.save_file(bin_file))
+  {
+    cout << "  could not write " << bin_file << endl;
+    return false;
+  }
+
+  // A corrupted header must be rejected: a huge count (bit 62) would
+  //   otherwise overflow the array bounds checks, and max_s is only covered
+  //   by the checksum
+  bool count_rejected = !corrupt_map_accepted(bin_file, offsetof(MapFileHeader, count) + 7, 6);
+  bool max_s_rejected = !corrupt_map_accepted(bin_file, offsetof(MapFileHeader, max_s), 0);
+  size_t payload_start;
+  {
+    MappedMapFile mapped;
+    mapped.open(bin_file);
+    payload_start = mapped.header().offset[MAP_X];
+  }
+  bool payload_rejected = !corrupt_map_accepted(bin_file, payload_start, 3);
+  cout << "  corrupted count rejected: " << (count_rejected ? "yes" : "NO") << endl;
+  cout << "  corrupted max_s rejected: " << (max_s_rejected ? "yes" : "NO") << endl;
+  cout << "  corrupted payload rejected: " << (payload_rejected ? "yes" : "NO") << endl;
+
+  // Header values the planner cannot use must be rejected even when the
+  //   checksum matches
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const double inf = std::numeric_limits<double>::infinity();
+  const double width = map.lane_width();
+  const int lanes = map.lane_count();
+  bool values_rejected = !bad_header_map_accepted(map, 0.0, lanes, width) &&
+                         !bad_header_map_accepted(map, -map.max_s(), lanes, width) &&
+                         !bad_header_map_accepted(map, nan, lanes, width) &&
+                         !bad_header_map_accepted(map, inf, lanes, width) &&
+                         !bad_header_map_accepted(map, map.max_s(), 0, width) &&
+                         !bad_header_map_accepted(map, map.max_s(), 1000000, width) &&
+                         !bad_header_map_accepted(map, map.max_s(), lanes, 0.0) &&
+                         !bad_header_map_accepted(map, map.max_s(), lanes, -width) &&
+                         !bad_header_map_accepted(map, map.max_s(), lanes, nan);
+  // the same writer with the map's own values, so the rejections are not
+  //   failures to write
+  bool good_values_accepted = bad_header_map_accepted(map, map.max_s(), lanes, width);
+  cout << "  corrupted max_s, lane_count and lane_width rejected: "
+       << ((values_rejected && good_values_accepted) ? "yes" : "NO") << endl;
+
+  // Rewriting a map file that is mapped by a live TrackMap, as the converter
+  //   does during a hot reload, must leave the live map's pages intact
+  TrackMap live;
+  live.load_file(bin_file);
+  double live_x = live.x()[live.size() / 2];
+  map.save_file(bin_file);
+  bool rewrite_safe = live.x()[live.size() / 2] == live_x;
+  cout << "  live map intact after rewrite: " << (rewrite_safe ? "yes" : "NO") << endl;
+
+  const int reps = 200;
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    TrackMap loaded;
+    loaded.load_csv(map_file, map.max_s());
+    sink += loaded.arc_s()[loaded.size()];
+  }
+  report("TrackMap::load_csv", ns_per_op(start, reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    TrackMap loaded;
+    loaded.load_file(bin_file);
+    sink += loaded.arc_s()[loaded.size()];
+  }
+  report("TrackMap::load_file (with grid)", ns_per_op(start, reps));
+
+  start = Clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    MappedMapFile mapped;
+    mapped.open(bin_file);
+    sink += mapped.array(MAP_ARC_S)[mapped.count()];
+  }
+  report("MappedMapFile::open (zero copy)", ns_per_op(start, reps));
+
+  remove(bin_file.c_str());
+  return count_rejected && max_s_rejected && payload_rejected && values_rejected &&
+         good_values_accepted && rewrite_safe;
+}
+
+
+int main(int argc, char **argv)
+{
+  // Waypoint map to read from
+  string map_file_ = (argc > 1) ? argv[1] : "../data/highway_map.csv";
+
+  TrackMap map;
+  if (!map.load_csv(map_file_, 6945.554))
+  {
+    std::cerr << "Failed to load map " << map_file_ << std::endl;
+    return -1;
+  }
+
+  bool frenet_ok = check_frenet(map);
+  bench_getxy(map);
+  bool value_api_ok = bench_value_api(map);
+  bench_track_model(map);
+  bool spline_fit_ok = bench_spline_fit();
+  bool fixed_spline_ok = bench_fixed_spline();
+  bool eval_ok = bench_spline_eval();
+  bench_trajectory_path(map);
+  bench_arc_length(map);
+  bool reuse_ok = bench_spline_reuse();
+  bool jmt_ok = bench_jmt();
+  bool cache_ok = bench_spline_cache(map);
+  bool boundary_ok = bench_spline_boundary();
+  bool vehicle_table_ok = bench_vehicle_table();
+  bool lane_kernel_ok = bench_lane_kernel(map);
+  bool tracker_ok = bench_tracker();
+  bool prediction_ok = bench_prediction();
+  bool map_file_ok = bench_map_loading(map_file_, map);
+  bool ok = frenet_ok && value_api_ok && spline_fit_ok && fixed_spline_ok && eval_ok && reuse_ok &&
+            jmt_ok && cache_ok && boundary_ok && vehicle_table_ok && lane_kernel_ok &&
+            tracker_ok && prediction_ok && map_file_ok;
+  return ok ? 0 : 1;
+}
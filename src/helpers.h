@@ -2,8 +2,10 @@
 #define HELPERS_H
 
 #include <math.h>
+#include <algorithm>
 #include <string>
 #include <vector>
+#include "waypoint_grid.h"
 
 // for convenience
 using std::string;
@@ -39,13 +41,24 @@ double distance(double x1, double y1, double x2, double y2) {
   return sqrt((x2-x1)*(x2-x1)+(y2-y1)*(y2-y1));
 }
 
+// Positions returned by value from the allocation-free conversions below
+struct Cartesian {
+  double x;
+  double y;
+};
+
+struct Frenet {
+  double s;
+  double d;
+};
+
 // Calculate closest waypoint to current x, y position
-int ClosestWaypoint(double x, double y, const vector<double> &maps_x, 
-                    const vector<double> &maps_y) {
+int ClosestWaypoint(double x, double y, const double *maps_x,
+                    const double *maps_y, int n) {
   double closestLen = 100000; //large number
   int closestWaypoint = 0;
 
-  for (int i = 0; i < maps_x.size(); ++i) {
+  for (int i = 0; i < n; ++i) {
     double map_x = maps_x[i];
     double map_y = maps_y[i];
     double dist = distance(x,y,map_x,map_y);
@@ -58,11 +71,82 @@ int ClosestWaypoint(double x, double y, const vector<double> &maps_x,
   return closestWaypoint;
 }
 
-// Returns next waypoint of the closest waypoint
-int NextWaypoint(double x, double y, double theta, const vector<double> &maps_x, 
-                 const vector<double> &maps_y) {
-  int closestWaypoint = ClosestWaypoint(x,y,maps_x,maps_y);
+int ClosestWaypoint(double x, double y, const vector<double> &maps_x, 
+                    const vector<double> &maps_y) {
+  return ClosestWaypoint(x,y,maps_x.data(),maps_y.data(),maps_x.size());
+}
+
+// Calculate closest waypoint to current x, y position using a spatial index
+//   built at map load time
+int ClosestWaypoint(double x, double y, const WaypointGrid &grid) {
+  return grid.closest(x,y);
+}
+
+// Walk along the track from waypoint start, in both directions, while the
+//   distance to x, y keeps dropping. Returns the local minimum reached and
+//   sets dist to its distance.
+int ClimbToWaypoint(double x, double y, const double *maps_x,
+                    const double *maps_y, int n, int start, double &dist) {
+  int closestWaypoint = start;
+  double closestLen = distance(x,y,maps_x[start],maps_y[start]);
+  for (int step = 1; step >= -1; step -= 2) {
+    int i = (closestWaypoint+step+n)%n;
+    double dist_i = distance(x,y,maps_x[i],maps_y[i]);
+    while (dist_i < closestLen) {
+      closestLen = dist_i;
+      closestWaypoint = i;
+      i = (i+step+n)%n;
+      dist_i = distance(x,y,maps_x[i],maps_y[i]);
+    }
+  }
+
+  dist = closestLen;
+  return closestWaypoint;
+}
+
+// Whether a waypoint found by ClimbToWaypoint() can be trusted: a point on
+//   the road is never further from its closest waypoint than the longer of
+//   the two segments meeting there. A climb from a stale hint that stopped
+//   in a local minimum elsewhere on the track fails this test.
+bool WaypointInReach(int wp, double dist, const double *maps_x,
+                     const double *maps_y, int n) {
+  int prev = (wp-1+n)%n;
+  int next = (wp+1)%n;
+  double reach = std::max(distance(maps_x[prev],maps_y[prev],maps_x[wp],maps_y[wp]),
+                          distance(maps_x[wp],maps_y[wp],maps_x[next],maps_y[next]));
+  return dist <= reach;
+}
+
+// Calculate closest waypoint to current x, y position, warm-started from the
+//   waypoint found on the previous call. Between two frames a car moves a few
+//   metres, so walking along the track from the hint while the distance keeps
+//   dropping only visits a handful of waypoints. A negative hint, or a walk
+//   that ends out of reach of the point (a stale hint after a reset or a
+//   reused vehicle ID), falls back to the full scan. The hint is updated with
+//   the result.
+int ClosestWaypoint(double x, double y, const double *maps_x,
+                    const double *maps_y, int n, int &hint) {
+  if (hint >= 0 && hint < n) {
+    double dist;
+    int closestWaypoint = ClimbToWaypoint(x,y,maps_x,maps_y,n,hint,dist);
+    if (WaypointInReach(closestWaypoint,dist,maps_x,maps_y,n)) {
+      hint = closestWaypoint;
+      return closestWaypoint;
+    }
+  }
+
+  hint = ClosestWaypoint(x,y,maps_x,maps_y,n);
+  return hint;
+}
 
+int ClosestWaypoint(double x, double y, const vector<double> &maps_x, 
+                    const vector<double> &maps_y, int &hint) {
+  return ClosestWaypoint(x,y,maps_x.data(),maps_y.data(),maps_x.size(),hint);
+}
+
+// Returns next waypoint of the given closest waypoint
+int NextWaypoint(int closestWaypoint, double x, double y, double theta,
+                 const double *maps_x, const double *maps_y, int n) {
   double map_x = maps_x[closestWaypoint];
   double map_y = maps_y[closestWaypoint];
 
@@ -73,7 +157,7 @@ int NextWaypoint(double x, double y, double theta, const vector<double> &maps_x,
 
   if (angle > pi()/2) {
     ++closestWaypoint;
-    if (closestWaypoint == maps_x.size()) {
+    if (closestWaypoint == n) {
       closestWaypoint = 0;
     }
   }
@@ -81,6 +165,32 @@ int NextWaypoint(double x, double y, double theta, const vector<double> &maps_x,
   return closestWaypoint;
 }
 
+int NextWaypoint(int closestWaypoint, double x, double y, double theta,
+                 const vector<double> &maps_x, const vector<double> &maps_y) {
+  return NextWaypoint(closestWaypoint,x,y,theta,maps_x.data(),maps_y.data(),
+                      maps_x.size());
+}
+
+// Returns next waypoint of the closest waypoint
+int NextWaypoint(double x, double y, double theta, const vector<double> &maps_x, 
+                 const vector<double> &maps_y) {
+  return NextWaypoint(ClosestWaypoint(x,y,maps_x,maps_y),x,y,theta,maps_x,maps_y);
+}
+
+// Returns next waypoint of the closest waypoint, found with a spatial index
+int NextWaypoint(double x, double y, double theta, const vector<double> &maps_x, 
+                 const vector<double> &maps_y, const WaypointGrid &grid) {
+  return NextWaypoint(ClosestWaypoint(x,y,grid),x,y,theta,maps_x,maps_y);
+}
+
+// Returns next waypoint of the closest waypoint, warm-started from the closest
+//   waypoint of the previous call (see the hinted ClosestWaypoint above)
+int NextWaypoint(double x, double y, double theta, const vector<double> &maps_x, 
+                 const vector<double> &maps_y, int &hint) {
+  int closestWaypoint = ClosestWaypoint(x,y,maps_x,maps_y,hint);
+  return NextWaypoint(closestWaypoint,x,y,theta,maps_x,maps_y);
+}
+
 // Transform from Cartesian x,y coordinates to Frenet s,d coordinates
 vector<double> getFrenet(double x, double y, double theta, 
                          const vector<double> &maps_x, 
@@ -126,17 +236,102 @@ vector<double> getFrenet(double x, double y, double theta,
   return {frenet_s,frenet_d};
 }
 
-// Transform from Frenet s,d coordinates to Cartesian x,y
-vector<double> getXY(double s, double d, const vector<double> &maps_s, 
-                     const vector<double> &maps_x, 
-                     const vector<double> &maps_y) {
-  int prev_wp = -1;
+// Cumulative arc length along the waypoint polyline, built once when the map
+//   is loaded. Entry i is the distance from waypoint 0 to waypoint i, and the
+//   extra last entry closes the loop back to waypoint 0.
+vector<double> getArcLengths(const vector<double> &maps_x,
+                             const vector<double> &maps_y) {
+  int n = maps_x.size();
+  vector<double> arc_s(n+1, 0.0);
+
+  for (int i = 0; i < n; ++i) {
+    int next = (i+1)%n;
+    arc_s[i+1] = arc_s[i]+distance(maps_x[i],maps_y[i],maps_x[next],maps_y[next]);
+  }
 
-  while (s > maps_s[prev_wp+1] && (prev_wp < (int)(maps_s.size()-1))) {
-    ++prev_wp;
+  return arc_s;
+}
+
+// Transform from Cartesian x,y coordinates to Frenet s,d coordinates using a
+//   precomputed arc length table from getArcLengths(), so s costs O(1) after
+//   the closest waypoint search. The table holds the same partial sums in the
+//   same order as the loop in getFrenet() above, so both agree to within
+//   floating point rounding (in practice bit for bit, well below 1e-9 m).
+Frenet getFrenet(int next_wp, double x, double y, const double *maps_x,
+                 const double *maps_y, int n, const double *maps_arc_s) {
+  int prev_wp;
+  prev_wp = next_wp-1;
+  if (next_wp == 0) {
+    prev_wp  = n-1;
   }
 
-  int wp2 = (prev_wp+1)%maps_x.size();
+  double n_x = maps_x[next_wp]-maps_x[prev_wp];
+  double n_y = maps_y[next_wp]-maps_y[prev_wp];
+  double x_x = x - maps_x[prev_wp];
+  double x_y = y - maps_y[prev_wp];
+
+  // find the projection of x onto n
+  double proj_norm = (x_x*n_x+x_y*n_y)/(n_x*n_x+n_y*n_y);
+  double proj_x = proj_norm*n_x;
+  double proj_y = proj_norm*n_y;
+
+  double frenet_d = distance(x_x,x_y,proj_x,proj_y);
+
+  //see if d value is positive or negative by comparing it to a center point
+  double center_x = 1000-maps_x[prev_wp];
+  double center_y = 2000-maps_y[prev_wp];
+  double centerToPos = distance(center_x,center_y,x_x,x_y);
+  double centerToRef = distance(center_x,center_y,proj_x,proj_y);
+
+  if (centerToPos <= centerToRef) {
+    frenet_d *= -1;
+  }
+
+  // calculate s value
+  double frenet_s = maps_arc_s[prev_wp]+distance(0,0,proj_x,proj_y);
+
+  Frenet frenet = {frenet_s,frenet_d};
+  return frenet;
+}
+
+vector<double> getFrenet(double x, double y, double theta, 
+                         const vector<double> &maps_x, 
+                         const vector<double> &maps_y,
+                         const vector<double> &maps_arc_s) {
+  int next_wp = NextWaypoint(x,y, theta, maps_x,maps_y);
+  Frenet frenet = getFrenet(next_wp,x,y,maps_x.data(),maps_y.data(),
+                            maps_x.size(),maps_arc_s.data());
+  return {frenet.s,frenet.d};
+}
+
+// Same as above, with the closest waypoint search done by a spatial index
+vector<double> getFrenet(double x, double y, double theta, 
+                         const vector<double> &maps_x, 
+                         const vector<double> &maps_y,
+                         const vector<double> &maps_arc_s,
+                         const WaypointGrid &grid) {
+  int next_wp = NextWaypoint(x,y, theta, maps_x,maps_y, grid);
+  Frenet frenet = getFrenet(next_wp,x,y,maps_x.data(),maps_y.data(),
+                            maps_x.size(),maps_arc_s.data());
+  return {frenet.s,frenet.d};
+}
+
+// Same as above, warm-started from the closest waypoint of the previous call
+vector<double> getFrenet(double x, double y, double theta, 
+                         const vector<double> &maps_x, 
+                         const vector<double> &maps_y,
+                         const vector<double> &maps_arc_s, int &hint) {
+  int next_wp = NextWaypoint(x,y, theta, maps_x,maps_y, hint);
+  Frenet frenet = getFrenet(next_wp,x,y,maps_x.data(),maps_y.data(),
+                            maps_x.size(),maps_arc_s.data());
+  return {frenet.s,frenet.d};
+}
+
+// Transform from Frenet s,d coordinates to Cartesian x,y on map segment
+//   prev_wp
+Cartesian getXY(int prev_wp, double s, double d, const double *maps_s,
+                const double *maps_x, const double *maps_y, int n) {
+  int wp2 = (prev_wp+1)%n;
 
   double heading = atan2((maps_y[wp2]-maps_y[prev_wp]),
                          (maps_x[wp2]-maps_x[prev_wp]));
@@ -148,10 +343,147 @@ vector<double> getXY(double s, double d, const vector<double> &maps_s,
 
   double perp_heading = heading-pi()/2;
 
-  double x = seg_x + d*cos(perp_heading);
-  double y = seg_y + d*sin(perp_heading);
+  Cartesian xy = {seg_x + d*cos(perp_heading),
+                  seg_y + d*sin(perp_heading)};
+  return xy;
+}
+
+// Transform from Frenet s,d coordinates to Cartesian x,y
+vector<double> getXY(double s, double d, const vector<double> &maps_s, 
+                     const vector<double> &maps_x, 
+                     const vector<double> &maps_y) {
+  int prev_wp = -1;
+
+  while (s > maps_s[prev_wp+1] && (prev_wp < (int)(maps_s.size()-1))) {
+    ++prev_wp;
+  }
+
+  Cartesian xy = getXY(prev_wp,s,d,maps_s.data(),maps_x.data(),maps_y.data(),
+                       maps_x.size());
+  return {xy.x,xy.y};
+}
+
+// Index of the map segment [maps_s[i], maps_s[i+1]) holding s, searched
+//   locally from the segment found on the previous call. s is wrapped into
+//   [0, max_s) first, and the walk steps around the loop in whichever
+//   direction is shorter, so crossing the start line costs one step. If the
+//   hint is negative or more than a few segments off, a binary search is
+//   used instead. The hint is updated with the result.
+int SegmentAt(double s, const double *maps_s, int n, double max_s, int &hint) {
+  const int max_walk = 8;
+  s = fmod(s, max_s);
+  if (s < 0) {
+    s += max_s;
+  }
+
+  int i = hint;
+  if (i >= 0 && i < n) {
+    double ds = s-maps_s[i];
+    if (ds < -max_s/2) {
+      ds += max_s;
+    } else if (ds > max_s/2) {
+      ds -= max_s;
+    }
+
+    int step = (ds >= 0) ? 1 : n-1;
+    for (int walked = 0; walked < max_walk; ++walked) {
+      if (s >= maps_s[i] && (i == n-1 || s < maps_s[i+1])) {
+        hint = i;
+        return i;
+      }
+      i = (i+step)%n;
+    }
+  }
+
+  i = std::upper_bound(maps_s, maps_s+n, s)-maps_s-1;
+  hint = std::max(i, 0);
+  return hint;
+}
+
+int SegmentAt(double s, const vector<double> &maps_s, double max_s, int &hint) {
+  return SegmentAt(s, maps_s.data(), maps_s.size(), max_s, hint);
+}
+
+// Transform from Frenet s,d coordinates to Cartesian x,y, warm-started from
+//   the segment found on the previous call, with s wrapped at max_s
+vector<double> getXY(double s, double d, const vector<double> &maps_s, 
+                     const vector<double> &maps_x, 
+                     const vector<double> &maps_y, double max_s, int &hint) {
+  int prev_wp = SegmentAt(s, maps_s, max_s, hint);
+  s = fmod(s, max_s);
+  if (s < 0) {
+    s += max_s;
+  }
+
+  Cartesian xy = getXY(prev_wp,s,d,maps_s.data(),maps_x.data(),maps_y.data(),
+                       maps_x.size());
+  return {xy.x,xy.y};
+}
+
+// Heading of every map segment i -> i+1 (wrapping to waypoint 0), stored as
+//   cos/sin so Frenet to Cartesian conversions need no trig per call
+void getHeadings(const vector<double> &maps_x, const vector<double> &maps_y,
+                 vector<double> &heading_cos, vector<double> &heading_sin) {
+  int n = maps_x.size();
+  heading_cos.resize(n);
+  heading_sin.resize(n);
+
+  for (int i = 0; i < n; ++i) {
+    int next = (i+1)%n;
+    double heading = atan2((maps_y[next]-maps_y[i]),(maps_x[next]-maps_x[i]));
+    heading_cos[i] = cos(heading);
+    heading_sin[i] = sin(heading);
+  }
+}
+
+// Batch transform from Frenet s,d coordinates to Cartesian x,y, writing into
+//   caller provided buffers. Segments are looked up with a running hint (cheap
+//   for sorted s), then a block of points is rotated by the precomputed
+//   segment headings from getHeadings() in a straight-line loop the compiler
+//   vectorizes. s is wrapped at max_s.
+void getXYBatch(const double *s, const double *d, double *x, double *y,
+                size_t n, const double *maps_s, const double *maps_x,
+                const double *maps_y, const double *heading_cos,
+                const double *heading_sin, int map_size, double max_s) {
+  const size_t block = 64;
+  double seg_s[block], base_x[block], base_y[block], cos_h[block], sin_h[block];
+  int hint = -1;
+
+  for (size_t start = 0; start < n; start += block) {
+    size_t count = std::min(block, n-start);
+
+    // gather the segment of every point in the block
+    for (size_t k = 0; k < count; ++k) {
+      double s_k = fmod(s[start+k], max_s);
+      if (s_k < 0) {
+        s_k += max_s;
+      }
+      int wp = SegmentAt(s_k, maps_s, map_size, max_s, hint);
+      seg_s[k] = s_k-maps_s[wp];
+      base_x[k] = maps_x[wp];
+      base_y[k] = maps_y[wp];
+      cos_h[k] = heading_cos[wp];
+      sin_h[k] = heading_sin[wp];
+    }
+
+    // move along the segment by seg_s and along its right normal by d
+    const double *d_block = d+start;
+    double *x_block = x+start;
+    double *y_block = y+start;
+    for (size_t k = 0; k < count; ++k) {
+      x_block[k] = base_x[k]+seg_s[k]*cos_h[k]+d_block[k]*sin_h[k];
+      y_block[k] = base_y[k]+seg_s[k]*sin_h[k]-d_block[k]*cos_h[k];
+    }
+  }
+}
 
-  return {x,y};
+void getXYBatch(const double *s, const double *d, double *x, double *y,
+                size_t n, const vector<double> &maps_s,
+                const vector<double> &maps_x, const vector<double> &maps_y,
+                const vector<double> &heading_cos,
+                const vector<double> &heading_sin, double max_s) {
+  getXYBatch(s, d, x, y, n, maps_s.data(), maps_x.data(), maps_y.data(),
+             heading_cos.data(), heading_sin.data(), maps_s.size(), max_s);
 }
 
 #endif  // HELPERS_H
\ No newline at end of file
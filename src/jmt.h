@@ -0,0 +1,147 @@
+#ifndef JMT_H
+#define JMT_H
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/LU"
+
+//
+// Jerk minimising trajectories. A 1D motion from position, velocity and
+//   acceleration (p0, v0, a0) to (p1, v1, a1) in time T with minimum
+//   integrated squared jerk is the quintic
+//
+//     p(t) = p0 + v0 t + a0/2 t^2 + c3 t^3 + c4 t^4 + c5 t^5
+//
+//   where c3..c5 solve a 3x3 system whose matrix depends on T only. Used
+//   for s and d separately to build candidate manoeuvres in Frenet space.
+//
+
+// Start or end state of a 1D motion
+struct MotionState {
+  double p, v, a;
+};
+
+// Quintic p(t) = c[0] + c[1] t + ... + c[5] t^5 over 0 <= t <= T
+struct Quintic {
+  double c[6];
+  double T;
+
+  double position(double t) const {
+    return c[0]+t*(c[1]+t*(c[2]+t*(c[3]+t*(c[4]+t*c[5]))));
+  }
+  double velocity(double t) const {
+    return c[1]+t*(2*c[2]+t*(3*c[3]+t*(4*c[4]+t*5*c[5])));
+  }
+  double acceleration(double t) const {
+    return 2*c[2]+t*(6*c[3]+t*(12*c[4]+t*20*c[5]));
+  }
+  double jerk(double t) const {
+    return 6*c[3]+t*(24*c[4]+t*60*c[5]);
+  }
+};
+
+// Matrix of the end conditions for c3..c5 at horizon T
+Eigen::Matrix3d jmtMatrix(double T) {
+  double T2 = T*T;
+  double T3 = T2*T;
+  Eigen::Matrix3d A;
+  A << T3, T3*T, T3*T2,
+       3*T2, 4*T3, 5*T3*T,
+       6*T, 12*T2, 20*T3;
+  return A;
+}
+
+// Quintic from start to end given the inverse of jmtMatrix(T)
+Quintic jmtFromInverse(const MotionState &start, const MotionState &end,
+                       double T, const Eigen::Matrix3d &inverse) {
+  Eigen::Vector3d b(end.p-(start.p+start.v*T+0.5*start.a*T*T),
+                    end.v-(start.v+start.a*T),
+                    end.a-start.a);
+  Eigen::Vector3d c = inverse*b;
+
+  Quintic q;
+  q.c[0] = start.p;
+  q.c[1] = start.v;
+  q.c[2] = 0.5*start.a;
+  q.c[3] = c(0);
+  q.c[4] = c(1);
+  q.c[5] = c(2);
+  q.T = T;
+  return q;
+}
+
+// Jerk minimising trajectory from start to end in time T, solving the 3x3
+//   system from scratch
+Quintic solveJMT(const MotionState &start, const MotionState &end, double T) {
+  return jmtFromInverse(start, end, T, jmtMatrix(T).inverse());
+}
+
+//
+// JMT solver for a fixed set of horizons T_k = t_min + k*dt. The inverse
+//   system matrix of every horizon is computed once up front, so each solve
+//   is one 3x3 matrix-vector product with no factorisation, which is what
+//   makes scoring ~1e5 candidates per frame affordable.
+//
+class JMTSolver {
+ public:
+  // No default constructor: a solver without horizons would index its
+  //   cache at -1
+  JMTSolver(double t_min, double t_max, double dt) {
+    build(t_min, t_max, dt);
+  }
+
+  // Cache the horizons from t_min to t_max in steps of dt, at least t_min
+  void build(double t_min, double t_max, double dt) {
+    assert(dt > 0 && t_max >= t_min);
+    t_min_ = t_min;
+    dt_ = dt;
+    int count = (int)floor((t_max-t_min)/dt+0.5)+1;
+    inverse_.resize(count);
+    for (int k = 0; k < count; ++k) {
+      inverse_[k] = jmtMatrix(horizon(k)).inverse();
+    }
+  }
+
+  int size() const { return inverse_.size(); }
+  double horizon(int k) const { return t_min_+k*dt_; }
+
+  // Index of the cached horizon nearest to T
+  int index(double T) const {
+    int k = (int)floor((T-t_min_)/dt_+0.5);
+    return std::min(std::max(k, 0), size()-1);
+  }
+
+  // Trajectory over cached horizon k. Named apart from solve() so an
+  //   integer horizon in seconds cannot pick a cache index by mistake.
+  Quintic solve_index(const MotionState &start, const MotionState &end,
+                      int k) const {
+    return jmtFromInverse(start, end, horizon(k), inverse_[k]);
+  }
+
+  // Trajectory over the cached horizon nearest to T; the horizon used is
+  //   returned in the quintic's T
+  Quintic solve(const MotionState &start, const MotionState &end,
+                double T) const {
+    return solve_index(start, end, index(T));
+  }
+
+  // Candidates from one start to n end states over horizon k, writing into
+  //   a caller provided buffer
+  void solve_index(const MotionState &start, const MotionState *end,
+                   Quintic *out, size_t n, int k) const {
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = solve_index(start, end[i], k);
+    }
+  }
+
+ private:
+  double t_min_;
+  double dt_;
+  std::vector<Eigen::Matrix3d> inverse_;
+};
+
+#endif  // JMT_H
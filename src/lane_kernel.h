@@ -0,0 +1,341 @@
+#ifndef LANE_KERNEL_H
+#define LANE_KERNEL_H
+
+#include <math.h>
+#include <stddef.h>
+
+// The vector path is compiled for AVX2 through a function attribute and
+//   chosen at run time, so it needs no -mavx2; LANE_KERNEL_NO_VECTOR
+//   leaves it out
+#if !defined(LANE_KERNEL_NO_VECTOR) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define LANE_KERNEL_AVX2
+#define LANE_KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+//
+// Lane occupancy around the ego car over the vehicle table's arrays: for
+//   every lane the nearest car ahead and behind, with their speeds, and
+//   which lanes leave room to merge.
+//
+// laneOccupancy() picks the fastest of three versions with the same results.
+//   For normal traffic it makes one branching pass, testing each vehicle
+//   only against its own lane. In dense traffic on AVX2 CPUs it tests 4
+//   vehicles at a time with compares and selects rather than branches; that
+//   path pays off from about 64 vehicles and is about twice as fast as the
+//   branching pass from 200. The branchless scalar version is the
+//   reference the others are checked against.
+//   A 2 double SSE2 path did not beat the branching pass at any traffic
+//   size, so other CPUs use the branching pass.
+//
+// Distances are measured around the loop wrapping at max_s. Vehicle
+//   positions may be up to one lap outside [0, max_s), which covers s
+//   predicted a few seconds ahead.
+//
+
+// Nearest cars of one lane, as seen from the ego car
+struct LaneOccupancy {
+  double leader_gap;      // distance ahead to the nearest car, max_s if none
+  double leader_speed;    // its speed, 0 if none
+  double follower_gap;    // distance back to the nearest car at or behind
+                          //   the ego car, max_s if none
+  double follower_speed;  // its speed, 0 if none
+};
+
+// Whether offset d lies in the lane from lo to hi. A car exactly on a lane
+//   line is in neither lane. Every version of laneOccupancy() uses this
+//   rule, the vector path with the same two compares.
+inline bool inLane(double d, double lo, double hi) {
+  return (d > lo) & (d < hi);
+}
+
+// Lane of offset d by the rule of inLane(), -1 on a lane line or off the
+//   road. The product with 1/lane_width, which a loop computes once, can
+//   round across a lane line; the rare d that fails the lane it picks is
+//   moved to the neighbouring lane and tested again.
+inline int laneOf(double d, int lane_count, double lane_width) {
+  if (!(d > 0 && d < lane_count*lane_width)) {
+    return -1;
+  }
+  int l = (int)(d*(1/lane_width));
+  if (inLane(d, l*lane_width, (l+1)*lane_width)) {
+    return l;
+  }
+  l += (d >= (l+1)*lane_width)-(d <= l*lane_width);
+  return inLane(d, l*lane_width, (l+1)*lane_width) ? l : -1;
+}
+
+// One vehicle of the branchless scalar path, also used for the tail of the
+//   vector path
+void laneOccupancyStep(double s, double d, double speed, double lo,
+                       double hi, double ego_s, double max_s,
+                       LaneOccupancy &lane) {
+  bool in_lane = inLane(d, lo, hi);
+  double gap = s-ego_s;
+  gap += (gap < 0) ? max_s : 0.0;
+  gap -= (gap >= max_s) ? max_s : 0.0;
+  bool ahead = gap > 0;
+  double behind = ahead ? max_s-gap : 0.0;
+  bool leader = in_lane & ahead & (gap < lane.leader_gap);
+  bool follower = in_lane & (behind < lane.follower_gap);
+  lane.leader_gap = leader ? gap : lane.leader_gap;
+  lane.leader_speed = leader ? speed : lane.leader_speed;
+  lane.follower_gap = follower ? behind : lane.follower_gap;
+  lane.follower_speed = follower ? speed : lane.follower_speed;
+}
+
+// Branchless scalar version of laneOccupancy()
+int laneOccupancyScalar(const double *s, const double *d,
+                        const double *speed, int n, double ego_s,
+                        int lane_count, double lane_width,
+                        double max_s, double merge_distance,
+                        LaneOccupancy *out) {
+  ego_s -= max_s*floor(ego_s/max_s);
+  int merge_mask = 0;
+  for (int l = 0; l < lane_count; ++l) {
+    double lo = l*lane_width;
+    double hi = lo+lane_width;
+    LaneOccupancy lane = {max_s, 0.0, max_s, 0.0};
+    for (int i = 0; i < n; ++i) {
+      laneOccupancyStep(s[i], d[i], speed[i], lo, hi, ego_s, max_s, lane);
+    }
+    out[l] = lane;
+    merge_mask |= (lane.leader_gap >= merge_distance &&
+                   lane.follower_gap >= merge_distance) << l;
+  }
+  return merge_mask;
+}
+
+#if defined(LANE_KERNEL_AVX2)
+typedef __m256d lane_vec;
+const int LANE_VEC_WIDTH = 4;
+LANE_KERNEL_AVX2_TARGET
+inline lane_vec laneSet(double x) { return _mm256_set1_pd(x); }
+LANE_KERNEL_AVX2_TARGET
+inline lane_vec laneLoad(const double *p) { return _mm256_loadu_pd(p); }
+LANE_KERNEL_AVX2_TARGET
+inline void laneStore(double *p, lane_vec a) { _mm256_storeu_pd(p, a); }
+LANE_KERNEL_AVX2_TARGET
+inline lane_vec laneAnd(lane_vec a, lane_vec b) { return _mm256_and_pd(a, b); }
+LANE_KERNEL_AVX2_TARGET
+inline lane_vec laneAdd(lane_vec a, lane_vec b) { return _mm256_add_pd(a, b); }
+LANE_KERNEL_AVX2_TARGET
+inline lane_vec laneSub(lane_vec a, lane_vec b) { return _mm256_sub_pd(a, b); }
+LANE_KERNEL_AVX2_TARGET
+inline lane_vec laneMin(lane_vec a, lane_vec b) { return _mm256_min_pd(a, b); }
+LANE_KERNEL_AVX2_TARGET
+inline lane_vec laneLess(lane_vec a, lane_vec b) {
+  return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+}
+LANE_KERNEL_AVX2_TARGET
+inline lane_vec laneGreaterEqual(lane_vec a, lane_vec b) {
+  return _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+}
+// mask ? b : a
+LANE_KERNEL_AVX2_TARGET
+inline lane_vec laneSelect(lane_vec a, lane_vec b, lane_vec mask) {
+  return _mm256_blendv_pd(a, b, mask);
+}
+#endif
+
+// Branching version of laneOccupancy(): one pass over the vehicles, each
+//   tested only against its own lane. Cheapest for the dozen or so cars of
+//   a normal frame.
+int laneOccupancyScan(const double *s, const double *d, const double *speed,
+                      int n, double ego_s, int lane_count,
+                      double lane_width, double max_s,
+                      double merge_distance, LaneOccupancy *out) {
+  ego_s -= max_s*floor(ego_s/max_s);
+  for (int l = 0; l < lane_count; ++l) {
+    LaneOccupancy empty = {max_s, 0.0, max_s, 0.0};
+    out[l] = empty;
+  }
+  for (int i = 0; i < n; ++i) {
+    int l = laneOf(d[i], lane_count, lane_width);
+    if (l < 0) {
+      continue;
+    }
+    LaneOccupancy &lane = out[l];
+    double gap = s[i]-ego_s;
+    if (gap < 0) {
+      gap += max_s;
+    }
+    if (gap >= max_s) {
+      gap -= max_s;
+    }
+    double behind = 0.0;
+    if (gap > 0) {
+      if (gap < lane.leader_gap) {
+        lane.leader_gap = gap;
+        lane.leader_speed = speed[i];
+      }
+      behind = max_s-gap;
+    }
+    if (behind < lane.follower_gap) {
+      lane.follower_gap = behind;
+      lane.follower_speed = speed[i];
+    }
+  }
+
+  int merge_mask = 0;
+  for (int l = 0; l < lane_count; ++l) {
+    merge_mask |= (out[l].leader_gap >= merge_distance &&
+                   out[l].follower_gap >= merge_distance) << l;
+  }
+  return merge_mask;
+}
+
+#if defined(LANE_KERNEL_AVX2)
+// Running minima of one lane, per vector slot
+struct LaneAccumulator {
+  lane_vec leader_gap;
+  lane_vec leader_speed;
+  lane_vec follower_gap;
+  lane_vec follower_speed;
+};
+
+// Fold the per slot minima of an accumulator into one lane
+LANE_KERNEL_AVX2_TARGET
+inline void laneOccupancyReduce(const LaneAccumulator &acc,
+                                LaneOccupancy &lane) {
+  double lg[LANE_VEC_WIDTH], ls[LANE_VEC_WIDTH];
+  double fg[LANE_VEC_WIDTH], fs[LANE_VEC_WIDTH];
+  laneStore(lg, acc.leader_gap);
+  laneStore(ls, acc.leader_speed);
+  laneStore(fg, acc.follower_gap);
+  laneStore(fs, acc.follower_speed);
+  for (int k = 0; k < LANE_VEC_WIDTH; ++k) {
+    if (lg[k] < lane.leader_gap) {
+      lane.leader_gap = lg[k];
+      lane.leader_speed = ls[k];
+    }
+    if (fg[k] < lane.follower_gap) {
+      lane.follower_gap = fg[k];
+      lane.follower_speed = fs[k];
+    }
+  }
+}
+
+// Vector path for LANES lanes starting at lane l0. LANES is a compile time
+//   constant so the accumulators of every lane stay in registers; each
+//   vehicle's gap is computed once and then tested against each lane.
+//   Returns the vehicles handled, a multiple of the vector width.
+template<int LANES>
+LANE_KERNEL_AVX2_TARGET
+int laneOccupancyVec(const double *s, const double *d, const double *speed,
+                     int n, double ego_s, int l0, double lane_width,
+                     double max_s, LaneOccupancy *out) {
+  const int width = LANE_VEC_WIDTH;
+  const lane_vec v_ego = laneSet(ego_s);
+  const lane_vec v_max_s = laneSet(max_s);
+  const lane_vec v_zero = laneSet(0.0);
+  lane_vec bound[LANES+1];
+  LaneAccumulator acc[LANES];
+  for (int k = 0; k <= LANES; ++k) {
+    bound[k] = laneSet((l0+k)*lane_width);
+  }
+  for (int k = 0; k < LANES; ++k) {
+    LaneAccumulator empty = {v_max_s, v_zero, v_max_s, v_zero};
+    acc[k] = empty;
+  }
+
+  int i = 0;
+  for (; i+width <= n; i += width) {
+    lane_vec vd = laneLoad(d+i);
+    lane_vec vv = laneLoad(speed+i);
+    lane_vec gap = laneSub(laneLoad(s+i), v_ego);
+    gap = laneAdd(gap, laneAnd(laneLess(gap, v_zero), v_max_s));
+    gap = laneSub(gap, laneAnd(laneGreaterEqual(gap, v_max_s), v_max_s));
+    lane_vec ahead = laneLess(v_zero, gap);
+    // candidate gaps, max_s when not ahead (behind) or at the car (ahead)
+    lane_vec leader_cand = laneSelect(v_max_s, gap, ahead);
+    lane_vec follower_cand = laneAnd(ahead, laneSub(v_max_s, gap));
+    lane_vec above = laneLess(bound[0], vd);
+    for (int k = 0; k < LANES; ++k) {
+      lane_vec below = laneLess(vd, bound[k+1]);
+      lane_vec in_lane = laneAnd(above, below);
+      above = laneLess(bound[k+1], vd);
+      // the running gaps only depend on themselves through a min, with
+      //   the speeds selected off that chain
+      lane_vec leader_k = laneSelect(v_max_s, leader_cand, in_lane);
+      lane_vec follower_k = laneSelect(v_max_s, follower_cand, in_lane);
+      lane_vec leader = laneLess(leader_k, acc[k].leader_gap);
+      lane_vec follower = laneLess(follower_k, acc[k].follower_gap);
+      acc[k].leader_gap = laneMin(leader_k, acc[k].leader_gap);
+      acc[k].follower_gap = laneMin(follower_k, acc[k].follower_gap);
+      acc[k].leader_speed = laneSelect(acc[k].leader_speed, vv, leader);
+      acc[k].follower_speed = laneSelect(acc[k].follower_speed, vv, follower);
+    }
+  }
+
+  for (int k = 0; k < LANES; ++k) {
+    LaneOccupancy lane = {max_s, 0.0, max_s, 0.0};
+    laneOccupancyReduce(acc[k], lane);
+    out[l0+k] = lane;
+  }
+  return i;
+}
+
+// Vehicles from which the vector path beats the branching pass
+const int LANE_KERNEL_MIN_VECTOR = 64;
+
+// Whether this CPU runs the vector path, checked once
+bool laneKernelHasAvx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+#endif
+
+// For each of lane_count lanes of lane_width metres, the nearest cars ahead
+//   of and behind ego_s among the n vehicles with positions s, d and speeds
+//   speed, written to out[lane]. Returns the merge mask: bit l is set when
+//   lane l has no car within merge_distance either side of ego_s.
+int laneOccupancy(const double *s, const double *d, const double *speed,
+                  int n, double ego_s, int lane_count,
+                  double lane_width, double max_s,
+                  double merge_distance, LaneOccupancy *out) {
+#if defined(LANE_KERNEL_AVX2)
+  if (n >= LANE_KERNEL_MIN_VECTOR && laneKernelHasAvx2()) {
+    ego_s -= max_s*floor(ego_s/max_s);
+    int merge_mask = 0;
+    for (int l0 = 0; l0 < lane_count; l0 += 4) {
+      int lanes = lane_count-l0;
+      int done;
+      switch (lanes) {
+        case 1:
+          done = laneOccupancyVec<1>(s, d, speed, n, ego_s, l0, lane_width,
+                                     max_s, out);
+          break;
+        case 2:
+          done = laneOccupancyVec<2>(s, d, speed, n, ego_s, l0, lane_width,
+                                     max_s, out);
+          break;
+        case 3:
+          done = laneOccupancyVec<3>(s, d, speed, n, ego_s, l0, lane_width,
+                                     max_s, out);
+          break;
+        default:
+          lanes = 4;
+          done = laneOccupancyVec<4>(s, d, speed, n, ego_s, l0, lane_width,
+                                     max_s, out);
+          break;
+      }
+      for (int k = l0; k < l0+lanes; ++k) {
+        double lo = k*lane_width;
+        for (int j = done; j < n; ++j) {
+          laneOccupancyStep(s[j], d[j], speed[j], lo, lo+lane_width, ego_s,
+                            max_s, out[k]);
+        }
+        merge_mask |= (out[k].leader_gap >= merge_distance &&
+                       out[k].follower_gap >= merge_distance) << k;
+      }
+    }
+    return merge_mask;
+  }
+#endif
+  return laneOccupancyScan(s, d, speed, n, ego_s, lane_count, lane_width,
+                           max_s, merge_distance, out);
+}
+
+#endif  // LANE_KERNEL_H
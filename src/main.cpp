@@ -1,4 +1,5 @@
 #include <uWS/uWS.h>
+#include <array>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -9,6 +10,11 @@
 #include "helpers.h"
 #include "json.hpp"
 #include "spline.h"
+#include "map_manager.h"
+#include "prediction.h"
+#include "lane_kernel.h"
+#include "tracker.h"
+#include "vehicle_table.h"
 
 
 // For convenience
@@ -46,72 +52,6 @@ class Point
 };
 
 
-class Car
-{
-  private:
-    Point velocity;
-  public:
-    double speed;
-    float d;
-    double s;
-    double future_s;
-    Car(double velocity_x, double velocity_y, float d, double s, int prev_size);
-    bool is_in_lane(int lane);
-    bool is_too_close(double s);
-    bool can_be_merged(double s);
-};
-
-
-Car::Car(double velocity_x, double velocity_y, float d, double s, int prev_size)
-{
-  this->velocity.x = velocity_x;
-  this->velocity.y = velocity_y;
-  this->speed = sqrt(pow(this->velocity.x, 2.0) + pow(this->velocity.y, 2.0));
-  this->d = d;
-  this->s = s;
-  this->future_s = this->s + ((double)prev_size*TIME_STEP*this->speed);
-}
-
-
-bool Car::is_in_lane(int lane)
-{
-  if (this->d < (2+4*lane+2) && this->d > (2+4*lane-2))
-  {
-    return true;
-  }
-  else
-  {
-    return false;
-  }
-}
-
-
-bool Car::is_too_close(double s)
-{
-  if ((this->future_s > s) && (this->future_s - s < CLOSE_DISTANCE))
-  {
-    return true;
-  }
-  else
-  {
-    return false;
-  }
-}
-
-
-bool Car::can_be_merged(double s)
-{
-  if ((this->s > s - MERGE_DISTANCE) && (this->s < s + MERGE_DISTANCE))
-  {
-    return false;
-  }
-  else
-  {
-    return true;
-  }
-}
-
-
 class AutonomousCar
 {
   public:
@@ -158,45 +98,43 @@ int main()
   // Web socket object
   uWS::Hub h;
 
-  // Load up map values for waypoint's x,y,s and d normalized normal vectors
-  vector<double> map_waypoints_x;
-  vector<double> map_waypoints_y;
-  vector<double> map_waypoints_s;
-  vector<double> map_waypoints_dx;
-  vector<double> map_waypoints_dy;
-
-  // Waypoint map to read from
+  // Waypoint map to read from, the binary map made by map_converter if present
   string map_file_ = "../data/highway_map.csv";
+  string map_bin_file_ = "../data/highway_map.bin";
 
   // The max s value before wrapping around the track back to 0
   double max_s = 6945.554;
 
-  // Load in map data from csv file
-  std::ifstream in_map_(map_file_.c_str(), std::ifstream::in);
-  string line;
-  while (getline(in_map_, line))
+  // Load up map values for waypoint's x,y,s and d normalized normal vectors, with the derived
+  // Frenet tables and smooth track model, and reload them in the background whenever the file changes
+  MapManager map_manager(map_bin_file_, map_file_, max_s);
+  if (!map_manager.load())
   {
-    std::istringstream iss(line);
-    double x;
-    double y;
-    float s;
-    float d_x;
-    float d_y;
-    iss >> x;
-    iss >> y;
-    iss >> s;
-    iss >> d_x;
-    iss >> d_y;
-    map_waypoints_x.push_back(x);
-    map_waypoints_y.push_back(y);
-    map_waypoints_s.push_back(s);
-    map_waypoints_dx.push_back(d_x);
-    map_waypoints_dy.push_back(d_y);
+    std::cerr << "Failed to load map " << map_file_ << std::endl;
+    return -1;
   }
+  map_manager.start();
+
+  // Trajectory spline, refitted every frame so its storage is reused
+  tk::spline2d path;
+
+  // Other cars of the current frame, refilled every frame so its storage is reused
+  VehicleTable vehicles;
+  vector<LaneOccupancy> lead_lanes;
+  vector<LaneOccupancy> merge_lanes;
+
+  // Tracks of the other cars by sensor fusion ID, timed by the simulator clock of the path points driven
+  Tracker tracker;
+  double sim_time = 0.0;
+
+  // Kalman filtered motion of the tracked cars, and their positions predicted to the end of the previous path
+  Predictor predictor;
+  vector<double> predicted_s;
+  vector<double> predicted_d;
 
   // Websocket communitcation
-  h.onMessage([&map_waypoints_x,&map_waypoints_y,&map_waypoints_s,
-               &map_waypoints_dx,&map_waypoints_dy]
+  h.onMessage([&map_manager, &path, &vehicles, &lead_lanes, &merge_lanes,
+               &tracker, &sim_time, &predictor, &predicted_s, &predicted_d]
               (uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
                uWS::OpCode opCode)
   {
@@ -209,6 +147,20 @@ int main()
         string event = j[0].get<string>();
         if (event == "telemetry")
         {
+          // Pin the current map for this message
+          MapManager::Reader map(map_manager);
+          const TrackMap &track_map = map.map();
+          const TrackModel &track = map.track();
+
+          // Keep the car's lane on the pinned map, which a reload may have given fewer lanes
+          if (autonomous_car.lane > track_map.lane_count() - 1)
+          {
+            autonomous_car.lane = track_map.lane_count() - 1;
+          }
+          if (autonomous_car.lane < 0)
+          {
+            autonomous_car.lane = 0;
+          }
         
           // Main car's localization data
           double car_x = j[1]["x"];
@@ -246,80 +198,49 @@ int main()
           // Update autonomous car object
           autonomous_car.update(car_x, car_y, car_s, car_d, car_yaw, car_speed);
 
-          // Loop over all cars in scene
-          for (int i = 0; i < sensor_fusion.size(); i++)
+          // Parse all cars in scene once, predicting them to the end of the previous path
+          vehicles.assign(sensor_fusion, (double)prev_size*TIME_STEP);
+
+          // Advance the clock by the points of the last path the car has driven since, then update
+          // the tracks of the other cars
+          sim_time += (50 - prev_size) * TIME_STEP;
+          tracker.update(vehicles, sim_time);
+
+          // Filter their motion and predict where they are when the car reaches the end of the previous path
+          predictor.update(tracker, vehicles, sim_time, track_map.max_s());
+          predicted_s.resize(vehicles.size());
+          predicted_d.resize(vehicles.size());
+          predictor.predict((double)prev_size*TIME_STEP, predicted_s.data(), predicted_d.data());
+
+          // Nearest cars of every lane, by their predicted position to find the car ahead and by their
+          // current position to find room to merge
+          int lane_count = track_map.lane_count();
+          lead_lanes.resize(lane_count);
+          merge_lanes.resize(lane_count);
+          laneOccupancy(predicted_s.data(), predicted_d.data(), vehicles.speed(), vehicles.size(),
+                        autonomous_car.s, lane_count, track_map.lane_width(), track_map.max_s(),
+                        MERGE_DISTANCE, lead_lanes.data());
+          int merge_mask = laneOccupancy(vehicles.s(), vehicles.d(), vehicles.speed(), vehicles.size(),
+                                         autonomous_car.s, lane_count, track_map.lane_width(),
+                                         track_map.max_s(), MERGE_DISTANCE, merge_lanes.data());
+
+          // Is the car ahead in my lane too close to me?
+          if (lead_lanes[autonomous_car.lane].leader_gap < CLOSE_DISTANCE)
           {
-            // Create car object
-            Car car = Car(sensor_fusion[i][3], sensor_fusion[i][4], sensor_fusion[i][6], sensor_fusion[i][5], prev_size);
+            autonomous_car.too_close = true;
 
-            // Is the car in my lane?
-            if(car.is_in_lane(autonomous_car.lane))
+            // Try to change to the left lane to overtake
+            if (autonomous_car.lane > 0 && (merge_mask >> (autonomous_car.lane - 1) & 1))
             {
+              autonomous_car.safe = true;
+              autonomous_car.lane -= 1;
+            }
 
-              // Is the car too close to me?
-              if(car.is_too_close(autonomous_car.s))
-              {
-                autonomous_car.too_close = true;
-
-                // Try to change to the left lane to overtake
-                if (autonomous_car.safe == false and autonomous_car.lane > 0)
-                {
-                  autonomous_car.safe = true;
-                  int target_lane = autonomous_car.lane - 1;
-                  for (int j = 0; j < sensor_fusion.size(); j++)
-                  {
-                    // Create merge car object
-                    Car merge_car = Car(sensor_fusion[j][3], sensor_fusion[j][4], sensor_fusion[j][6], sensor_fusion[j][5], prev_size);
-
-                    // Is the merge car in the target lane?
-                    if(merge_car.is_in_lane(target_lane))
-                    {
-
-                      // Is it safe to merge to the lane with this car here?
-                      if(merge_car.can_be_merged(autonomous_car.s) == false)
-                      { 
-                        autonomous_car.safe = false;
-                      }
-                    }
-                  }
-
-                  // If it is safe change the terget lane
-                  if (autonomous_car.safe == true)
-                  {
-                    autonomous_car.lane = target_lane;
-                  }
-                }
-
-                // Try to change to the right lane to overtake
-                if (autonomous_car.safe == false and autonomous_car.lane < 2)
-                {
-                  autonomous_car.safe = true;
-                  int target_lane = autonomous_car.lane + 1;
-                  for (int j = 0; j < sensor_fusion.size(); j++)
-                  {
-
-                    // Create merge car object
-                    Car merge_car = Car(sensor_fusion[j][3], sensor_fusion[j][4], sensor_fusion[j][6], sensor_fusion[j][5], prev_size);
-
-                    // Is the merge car in the target lane?
-                    if(merge_car.is_in_lane(target_lane))
-                    {
-
-                      // Is it safe to merge to the lane with this car here?
-                      if(merge_car.can_be_merged(autonomous_car.s) == false)
-                      { 
-                        autonomous_car.safe = false;
-                      }
-                    }
-                  }
-
-                  // If it is safe change the terget lane
-                  if (autonomous_car.safe == true)
-                  {
-                    autonomous_car.lane = target_lane;
-                  }
-                }
-              }
+            // Try to change to the right lane to overtake
+            else if (autonomous_car.lane < lane_count - 1 && (merge_mask >> (autonomous_car.lane + 1) & 1))
+            {
+              autonomous_car.safe = true;
+              autonomous_car.lane += 1;
             }
           }
 
@@ -335,61 +256,31 @@ int main()
             autonomous_car.target_vel += REACTION;
           }
 
-          // Create vector of points to act as waypoints to build splines
-          vector<double> pstx;
-          vector<double> psty;
-
-          // Get the ref positions
+          // Start the path where the previous path ends, or at the car, heading the same way
           double ref_x = autonomous_car.position.x;
           double ref_y = autonomous_car.position.y;
           double ref_yaw = deg2rad(autonomous_car.yaw);
-
-          // Add two waypoints of the currrent and last car position to ensure smoothness
-          if (prev_size < 2)
-          {
-            double prev_car_x = autonomous_car.position.x - cos(autonomous_car.yaw);
-            double prev_car_y = autonomous_car.position.y - sin(autonomous_car.yaw);
-            pstx.push_back(prev_car_x);
-            pstx.push_back(autonomous_car.position.x);
-            psty.push_back(prev_car_y);
-            psty.push_back(autonomous_car.position.y);
-          }
-          else
+          if (prev_size >= 2)
           {
             ref_x = previous_path_x[prev_size - 1];
             ref_y = previous_path_y[prev_size - 1];
             double ref_x_prev = previous_path_x[prev_size - 2];
             double ref_y_prev = previous_path_y[prev_size - 2];
             ref_yaw = atan2(ref_y - ref_y_prev, ref_x - ref_x_prev);
-            pstx.push_back(ref_x_prev);
-            pstx.push_back(ref_x);
-            psty.push_back(ref_y_prev);
-            psty.push_back(ref_y);
           }
 
           // Add three waypoints in the distance
-          vector<double> wp0 = getXY(autonomous_car.s+30, (2+4*autonomous_car.lane), map_waypoints_s, map_waypoints_x, map_waypoints_y);
-          vector<double> wp1 = getXY(autonomous_car.s+60, (2+4*autonomous_car.lane), map_waypoints_s, map_waypoints_x, map_waypoints_y);
-          vector<double> wp2 = getXY(autonomous_car.s+90, (2+4*autonomous_car.lane), map_waypoints_s, map_waypoints_x, map_waypoints_y);
-          pstx.push_back(wp0[0]);
-          pstx.push_back(wp1[0]);
-          pstx.push_back(wp2[0]);
-          psty.push_back(wp0[1]);
-          psty.push_back(wp1[1]);
-          psty.push_back(wp2[1]);
-
-          // Transform waypoints into AVs reference frame
-          for (int i = 0; i < pstx.size(); i++)
-          {
-            double shift_x = pstx[i] - ref_x;
-            double shift_y = psty[i] - ref_y;
-            pstx[i] = (shift_x * cos(0-ref_yaw) - shift_y * sin(0-ref_yaw));
-            psty[i] = (shift_x * sin(0-ref_yaw) + shift_y * cos(0-ref_yaw));
-          }
-          
-          // Add waypoints to spline
-          tk::spline s;
-          s.set_points(pstx, psty);
+          Cartesian wp0 = track.getXY(autonomous_car.s+30, track_map.lane_center(autonomous_car.lane));
+          Cartesian wp1 = track.getXY(autonomous_car.s+60, track_map.lane_center(autonomous_car.lane));
+          Cartesian wp2 = track.getXY(autonomous_car.s+90, track_map.lane_center(autonomous_car.lane));
+          std::array<double, 4> pstx = {{ref_x, wp0.x, wp1.x, wp2.x}};
+          std::array<double, 4> psty = {{ref_y, wp0.y, wp1.y, wp2.y}};
+
+          // Fit the path through the waypoints in world coordinates, with its arc length table, clamped
+          // to leave the end of the previous path along its heading
+          path.set_boundary(tk::spline::first_deriv, cos(ref_yaw), sin(ref_yaw), tk::spline::second_deriv, 0.0, 0.0);
+          path.set_points(pstx.data(), psty.data(), 4);
+          path.build_arc_length();
 
           // Start with the previous path
           for (int i = 0; i < prev_size; i++)
@@ -398,33 +289,26 @@ int main()
             next_y_vals.push_back(previous_path_y[i]);
           }
 
-          // Define the target x,y position
-          double target_x = 30.0;
-          double target_y = s(target_x);
-          double target_dist = sqrt(pow(target_x, 2.0) + pow(target_y, 2.0));
-          double x_add_on = 0;
-
-          // Add new points to the path
-          for (int i = 1; i <= 50 - prev_size; i++)
+          // Step along the path from the end of the previous path, so each 20 ms step covers exactly
+          // the distance driven at the target speed
+          double dist_inc = 0.02 * autonomous_car.target_vel / 2.24;
+          int new_points = 50 - prev_size;
+          double path_s[50];
+          double path_t[50];
+          double path_x[50];
+          double path_y[50];
+          for (int i = 0; i < new_points; i++)
           {
+            path_s[i] = (i + 1) * dist_inc;
+          }
+          path.t_at_arc_length(path_s, path_t, new_points);
+          path.eval_batch(path_t, path_x, path_y, new_points);
 
-            // Split spine into N points to ensure correct speed
-            double N = (target_dist/(0.02*autonomous_car.target_vel/2.24));
-            double x_point = x_add_on + target_x / N;
-            double y_point = s(x_point);
-            x_add_on = x_point;
-            double x_ref = x_point;
-            double y_ref = y_point;
-
-            // Transform the points back to the world reference frame
-            x_point = (x_ref * cos(ref_yaw) - y_ref * sin(ref_yaw));
-            y_point = (x_ref * sin(ref_yaw) + y_ref * cos(ref_yaw));
-            x_point += ref_x;
-            y_point += ref_y;
-
-            // Add the new points to the vector
-            next_x_vals.push_back(x_point);
-            next_y_vals.push_back(y_point);
+          // Add the new points to the path
+          for (int i = 0; i < new_points; i++)
+          {
+            next_x_vals.push_back(path_x[i]);
+            next_y_vals.push_back(path_y[i]);
           }
 
           // Websocket communitcation
@@ -0,0 +1,54 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include "track_map.h"
+
+
+// For convenience
+using std::string;
+using std::cout;
+using std::endl;
+
+
+// Converts a waypoint CSV map into the binary map format loaded by the planner
+//   usage: map_converter <map.csv> <map.bin> [max_s]
+// max_s defaults to the length of the closed waypoint loop.
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    std::cerr << "usage: " << argv[0] << " <map.csv> <map.bin> [max_s]" << std::endl;
+    return -1;
+  }
+  string csv_file = argv[1];
+  string bin_file = argv[2];
+
+  double max_s = (argc > 3) ? atof(argv[3]) : 0.0;
+
+  TrackMap map;
+  if (!map.load_csv(csv_file, max_s))
+  {
+    std::cerr << "Failed to load map " << csv_file << std::endl;
+    return -1;
+  }
+
+  if (!map.save_file(bin_file))
+  {
+    std::cerr << "Failed to write map " << bin_file << std::endl;
+    return -1;
+  }
+
+  // Read the file back to check it
+  TrackMap check;
+  if (!check.load_file(bin_file) || check.size() != map.size() ||
+      !std::equal(map.s(), map.s() + map.size(), check.s()))
+  {
+    std::cerr << "Failed to verify map " << bin_file << std::endl;
+    return -1;
+  }
+
+  cout << "Wrote " << map.size() << " waypoints with max_s " << map.max_s()
+       << " to " << bin_file << endl;
+  return 0;
+}
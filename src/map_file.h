@@ -0,0 +1,256 @@
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+//
+// Binary waypoint map format.
+//
+// Besides the simulator's CSV file, maps can be stored in a versioned binary
+//   format made by the map_converter tool. The file is a fixed header
+//   followed by one array of doubles per field (structure of arrays), each
+//   starting on a 64 byte boundary. The tables derived at load time (arc
+//   lengths, segment lengths and headings) are stored too, so loading is an
+//   mmap plus a checksum pass, with no parsing. Processes mapping the same
+//   file share one page cache copy, so a map file in use must be replaced by
+//   renaming a new file over it, as writeMapFile() does, never rewritten in
+//   place.
+//
+
+// Arrays stored in a binary map file, in file order
+enum MapFileArray {
+  MAP_X,            // waypoint x
+  MAP_Y,            // waypoint y
+  MAP_S,            // waypoint s
+  MAP_DX,           // waypoint unit normal x
+  MAP_DY,           // waypoint unit normal y
+  MAP_ARC_S,        // cumulative arc length, count+1 entries
+  MAP_SEG_LEN,      // length of segment i -> i+1
+  MAP_HEADING_COS,  // cos of the heading of segment i -> i+1
+  MAP_HEADING_SIN,  // sin of the heading of segment i -> i+1
+  MAP_ARRAY_COUNT
+};
+
+const char MAP_FILE_MAGIC[8] = {'P','P','M','A','P','\0','\0','\0'};
+const uint32_t MAP_FILE_VERSION = 3;
+const uint32_t MAP_FILE_BYTE_ORDER = 0x01020304;
+const uint64_t MAP_FILE_ALIGNMENT = 64;
+// Most lanes a map may have; the planner keeps one bit per lane in an int
+const uint32_t MAP_FILE_MAX_LANES = 16;
+
+struct MapFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;    // MAP_FILE_BYTE_ORDER as written by the converter
+  uint64_t count;         // number of waypoints
+  double max_s;           // the max s value before wrapping back to 0
+  uint32_t lane_count;    // lanes on the planner's side of the road
+  uint32_t reserved;
+  double lane_width;
+  uint64_t offset[MAP_ARRAY_COUNT];  // byte offset of each array in the file
+  uint64_t payload_size;  // bytes from the first array to the end of file
+  uint64_t checksum;      // mapFileChecksum() of the header and payload
+};
+
+// Bytes of the header covered by the checksum: every field before it
+const uint64_t MAP_FILE_HEADER_CHECKED = offsetof(MapFileHeader, checksum);
+
+// Entries in each array of a map with count waypoints
+uint64_t mapFileArrayLength(MapFileArray array, uint64_t count) {
+  return (array == MAP_ARC_S) ? count+1 : count;
+}
+
+// Offsets of the arrays of a map with count waypoints, relative to the start
+//   of the payload, each padded to the alignment. Returns the payload size.
+uint64_t mapFileLayout(uint64_t count, uint64_t offset[MAP_ARRAY_COUNT]) {
+  uint64_t size = 0;
+  for (int a = 0; a < MAP_ARRAY_COUNT; ++a) {
+    offset[a] = size;
+    size += mapFileArrayLength((MapFileArray)a, count)*sizeof(double);
+    size = (size+MAP_FILE_ALIGNMENT-1)/MAP_FILE_ALIGNMENT*MAP_FILE_ALIGNMENT;
+  }
+  return size;
+}
+
+// FNV-1a over 64 bit words of a block (the header fields and the payload are
+//   whole numbers of words since every array is padded to the alignment).
+//   Pass the result of a previous call as hash to continue over another block.
+uint64_t mapFileChecksum(const char *data, uint64_t size,
+                         uint64_t hash = 14695981039346656037ULL) {
+  for (uint64_t i = 0; i+8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data+i, 8);
+    hash ^= word;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Write size bytes to fd, retrying short writes
+bool writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+// Write a map file. arrays holds the MAP_ARRAY_COUNT arrays in file order.
+//   The map is written to a temporary file which is synced and then renamed
+//   over file, so a process that has the old file mapped keeps its old
+//   pages instead of seeing the file truncated under it (SIGBUS).
+bool writeMapFile(const std::string &file, uint64_t count, double max_s,
+                  uint32_t lane_count, double lane_width,
+                  const double *const arrays[MAP_ARRAY_COUNT]) {
+  MapFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAP_FILE_MAGIC, sizeof(header.magic));
+  header.version = MAP_FILE_VERSION;
+  header.byte_order = MAP_FILE_BYTE_ORDER;
+  header.count = count;
+  header.max_s = max_s;
+  header.lane_count = lane_count;
+  header.lane_width = lane_width;
+
+  uint64_t start = (sizeof(header)+MAP_FILE_ALIGNMENT-1)/MAP_FILE_ALIGNMENT*
+                   MAP_FILE_ALIGNMENT;
+  header.payload_size = mapFileLayout(count, header.offset);
+  std::vector<char> payload(header.payload_size, 0);
+  for (int a = 0; a < MAP_ARRAY_COUNT; ++a) {
+    memcpy(payload.data()+header.offset[a], arrays[a],
+           mapFileArrayLength((MapFileArray)a, count)*sizeof(double));
+    header.offset[a] += start;
+  }
+  header.checksum = mapFileChecksum(payload.data(), payload.size(),
+      mapFileChecksum((const char *)&header, MAP_FILE_HEADER_CHECKED));
+
+  std::vector<char> head(start, 0);
+  memcpy(head.data(), &header, sizeof(header));
+
+  std::string temp_file = file+".tmp";
+  int fd = ::open(temp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = writeAll(fd, head.data(), head.size()) &&
+            writeAll(fd, payload.data(), payload.size()) && fsync(fd) == 0;
+  ok = (::close(fd) == 0) && ok;
+  if (!ok || rename(temp_file.c_str(), file.c_str()) != 0) {
+    unlink(temp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+//
+// Read-only memory mapping of a binary map file. The arrays point straight
+//   into the mapping and stay valid for the lifetime of the object.
+//
+class MappedMapFile {
+ public:
+  MappedMapFile() : data_(NULL), size_(0) {}
+  ~MappedMapFile() { close(); }
+
+  // Map the file and validate its header and checksum
+  bool open(const std::string &file) {
+    close();
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(MapFileHeader)) {
+      ::close(fd);
+      return false;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    data_ = (const char *)data;
+    size_ = info.st_size;
+
+    if (!valid()) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (data_ != NULL) {
+      munmap((void *)data_, size_);
+    }
+    data_ = NULL;
+    size_ = 0;
+  }
+
+  bool is_open() const { return data_ != NULL; }
+  const MapFileHeader &header() const { return *(const MapFileHeader *)data_; }
+  size_t count() const { return header().count; }
+  double max_s() const { return header().max_s; }
+  int lane_count() const { return header().lane_count; }
+  double lane_width() const { return header().lane_width; }
+
+  const double *array(MapFileArray a) const {
+    return (const double *)(data_+header().offset[a]);
+  }
+
+ private:
+  MappedMapFile(const MappedMapFile &);
+  MappedMapFile &operator=(const MappedMapFile &);
+
+  bool valid() const {
+    const MapFileHeader &h = header();
+    if (memcmp(h.magic, MAP_FILE_MAGIC, sizeof(h.magic)) != 0 ||
+        h.version != MAP_FILE_VERSION ||
+        h.byte_order != MAP_FILE_BYTE_ORDER || h.count < 2 ||
+        h.lane_count < 1 || h.lane_count > MAP_FILE_MAX_LANES ||
+        h.count >= size_/sizeof(double) || h.payload_size > size_) {
+      return false;
+    }
+    // the planner divides by these and wraps s at max_s; the negated
+    //   comparisons also reject NaN
+    if (!(h.max_s > 0 && h.max_s <= DBL_MAX) ||
+        !(h.lane_width > 0 && h.lane_width <= DBL_MAX)) {
+      return false;
+    }
+    // count is bounded by the file size above, so bytes cannot overflow; the
+    //   bounds checks are written as subtractions so neither can they
+    uint64_t payload_start = size_-h.payload_size;
+    for (int a = 0; a < MAP_ARRAY_COUNT; ++a) {
+      uint64_t bytes = mapFileArrayLength((MapFileArray)a, h.count)*sizeof(double);
+      if (h.offset[a] < payload_start || h.offset[a]%MAP_FILE_ALIGNMENT != 0 ||
+          h.offset[a] > size_ || bytes > size_-h.offset[a]) {
+        return false;
+      }
+    }
+    uint64_t hash = mapFileChecksum(data_, MAP_FILE_HEADER_CHECKED);
+    return mapFileChecksum(data_+payload_start, h.payload_size, hash) ==
+           h.checksum;
+  }
+
+  const char *data_;
+  size_t size_;
+};
+
+#endif  // MAP_FILE_H
@@ -0,0 +1,186 @@
+#ifndef MAP_MANAGER_H
+#define MAP_MANAGER_H
+
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "track_map.h"
+#include "track_model.h"
+
+//
+// Hot-reloadable map. A background thread polls the binary and CSV map files,
+//   and when either changes builds a new TrackMap with its derived indexes and TrackModel
+//   off the control path, then publishes it with one atomic pointer swap.
+//
+// Readers pin the current map with a MapManager::Reader for the duration of
+//   one message. Pinning is two atomic increments, with no lock and no wait,
+//   so the 20 ms control path never stalls on a reload. A replaced map is
+//   freed by the watcher thread once no reader is active any more (a simple
+//   RCU grace period), so in-flight handlers keep using the old map safely.
+//
+
+// One loaded map with everything derived from it
+struct MapSnapshot {
+  TrackMap map;
+  TrackModel track;
+  unsigned int version;
+};
+
+class MapManager {
+ public:
+  // Loads bin_file if present and at least as new as csv_file, else csv_file
+  //   with the given max_s
+  MapManager(const string &bin_file, const string &csv_file, double max_s)
+      : bin_file_(bin_file), csv_file_(csv_file), max_s_(max_s),
+        current_(NULL), readers_(0), running_(false), version_(0) {}
+
+  ~MapManager() {
+    stop();
+    delete current_.load();
+  }
+
+  // Load the initial map, before the first reader
+  bool load() {
+    last_stamp_ = mapStamp();
+    MapSnapshot *snapshot = build();
+    if (snapshot == NULL) {
+      return false;
+    }
+    publish(snapshot);
+    return true;
+  }
+
+  // Start watching the map file for changes
+  void start(int poll_ms = 500) {
+    if (running_.exchange(true)) {
+      return;
+    }
+    watcher_ = std::thread(&MapManager::watch, this, poll_ms);
+  }
+
+  void stop() {
+    if (running_.exchange(false)) {
+      watcher_.join();
+    }
+  }
+
+  // Pins the current map while in scope. Keep readers short lived: a reload
+  //   frees the old map only once every reader that might see it has ended.
+  class Reader {
+   public:
+    explicit Reader(const MapManager &manager) : manager_(manager) {
+      manager_.readers_.fetch_add(1);
+      snapshot_ = manager_.current_.load();
+    }
+    ~Reader() { manager_.readers_.fetch_sub(1); }
+
+    const TrackMap &map() const { return snapshot_->map; }
+    const TrackModel &track() const { return snapshot_->track; }
+    unsigned int version() const { return snapshot_->version; }
+
+   private:
+    Reader(const Reader &);
+    Reader &operator=(const Reader &);
+
+    const MapManager &manager_;
+    const MapSnapshot *snapshot_;
+  };
+
+ private:
+  MapManager(const MapManager &);
+  MapManager &operator=(const MapManager &);
+
+  // Modification time and size of a map file, zero if it does not exist
+  struct FileStamp {
+    time_t mtime;
+    off_t size;
+    bool operator==(const FileStamp &other) const {
+      return mtime == other.mtime && size == other.size;
+    }
+  };
+
+  // Stamps of both map files, so an edited CSV is reloaded too
+  struct MapStamp {
+    FileStamp bin;
+    FileStamp csv;
+    bool operator==(const MapStamp &other) const {
+      return bin == other.bin && csv == other.csv;
+    }
+  };
+
+  static FileStamp fileStamp(const string &file) {
+    struct stat info;
+    FileStamp stamp = {0, 0};
+    if (stat(file.c_str(), &info) == 0) {
+      stamp.mtime = info.st_mtime;
+      stamp.size = info.st_size;
+    }
+    return stamp;
+  }
+
+  MapStamp mapStamp() const {
+    MapStamp stamp = {fileStamp(bin_file_), fileStamp(csv_file_)};
+    return stamp;
+  }
+
+  // Load the map and build its derived data, NULL if it cannot be loaded. A
+  //   CSV edited after the binary file was converted takes precedence, so
+  //   the planner never keeps driving a stale binary map.
+  MapSnapshot *build() {
+    MapStamp stamp = mapStamp();
+    bool bin_current = stamp.bin.mtime >= stamp.csv.mtime;
+    MapSnapshot *snapshot = new MapSnapshot;
+    if (!(bin_current && snapshot->map.load_file(bin_file_)) &&
+        !snapshot->map.load_csv(csv_file_, max_s_) &&
+        !snapshot->map.load_file(bin_file_)) {
+      delete snapshot;
+      return NULL;
+    }
+    snapshot->track.build(snapshot->map);
+    snapshot->version = ++version_;
+    return snapshot;
+  }
+
+  // Swap in a new map, then free the old one after the grace period
+  void publish(MapSnapshot *snapshot) {
+    const MapSnapshot *old = current_.exchange(snapshot);
+    while (readers_.load() != 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    delete old;
+  }
+
+  void watch(int poll_ms) {
+    MapStamp pending = last_stamp_;
+    while (running_.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+      MapStamp stamp = mapStamp();
+
+      // only reload once the files have stopped changing for a whole poll
+      //   interval, so a map still being written is not picked up
+      if (stamp == last_stamp_ || !(stamp == pending)) {
+        pending = stamp;
+        continue;
+      }
+      last_stamp_ = stamp;
+      MapSnapshot *snapshot = build();
+      if (snapshot != NULL) {
+        publish(snapshot);
+      }
+    }
+  }
+
+  string bin_file_;
+  string csv_file_;
+  double max_s_;
+  std::atomic<const MapSnapshot *> current_;
+  mutable std::atomic<int> readers_;
+  std::atomic<bool> running_;
+  std::thread watcher_;
+  MapStamp last_stamp_;
+  unsigned int version_;
+};
+
+#endif  // MAP_MANAGER_H
@@ -29,6 +29,8 @@
 
 #include <cstdio>
 #include <cassert>
+#include <cmath>
+#include <array>
 #include <vector>
 #include <algorithm>
 
@@ -41,38 +43,70 @@ namespace
 namespace tk
 {
 
-// band matrix solver
-class band_matrix
+// tridiagonal solvers (Thomas algorithm), O(n) and without heap allocation
+//   sub[i]*x[i-1] + diag[i]*x[i] + sup[i]*x[i+1] = rhs[i],  i=0,...,n-1
+// rhs is overwritten with the solution x
+//
+// plain system: sub[0] and sup[n-1] are ignored, scratch needs n entries
+void solve_tridiagonal(const double* sub, const double* diag,
+                       const double* sup, double* rhs, double* scratch,
+                       int n);
+// cyclic system: sub[0] couples x[n-1] into the first row and sup[n-1]
+// couples x[0] into the last row, solved with the Sherman-Morrison
+// formula; needs n>=3 and scratch of 3*n entries
+void solve_cyclic_tridiagonal(const double* sub, const double* diag,
+                              const double* sup, double* rhs,
+                              double* scratch, int n);
+
+
+// cumulative arc length of a curve sampled at a few points per spline
+// segment, each piece integrated with 5 point Gauss-Legendre, and its
+// inverse; Curve provides speed(seg,u), the length of the derivative on
+// segment seg at parameter u (also outside the knots, for extrapolation)
+template<class Curve>
+class arc_length_table
 {
 private:
-    std::vector< std::vector<double> > m_upper;  // upper band
-    std::vector< std::vector<double> > m_lower;  // lower band
+    std::vector<double> m_u;                // parameter at piece boundaries
+    std::vector<double> m_s;                // arc length at piece boundaries
+    std::vector<int>    m_seg;              // spline segment of each piece
+
+    int piece_of_param(double u) const;
+    double integrate(const Curve& curve, int seg, double u0,
+                     double u1) const;
+    double invert(const Curve& curve, double s, int piece) const;
+
 public:
-    band_matrix() {};                             // constructor
-    band_matrix(int dim, int n_u, int n_l);       // constructor
-    ~band_matrix() {};                            // destructor
-    void resize(int dim, int n_u, int n_l);      // init with dim,n_u,n_l
-    int dim() const;                             // matrix dimension
-    int num_upper() const
+    void clear()
     {
-        return m_upper.size()-1;
+        m_u.clear();
+        m_s.clear();
+        m_seg.clear();
     }
-    int num_lower() const
+    void reserve(int knots, int subdivisions)
     {
-        return m_lower.size()-1;
-    }
-    // access operator
-    double & operator () (int i, int j);            // write
-    double   operator () (int i, int j) const;      // read
-    // we can store an additional diogonal (in m_lower)
-    double& saved_diag(int i);
-    double  saved_diag(int i) const;
-    void lu_decompose();
-    std::vector<double> r_solve(const std::vector<double>& b) const;
-    std::vector<double> l_solve(const std::vector<double>& b) const;
-    std::vector<double> lu_solve(const std::vector<double>& b,
-                                 bool is_lu_decomposed=false);
-
+        m_u.reserve((knots-1)*subdivisions+1);
+        m_s.reserve((knots-1)*subdivisions+1);
+        m_seg.reserve((knots-1)*subdivisions+1);
+    }
+    bool empty() const
+    {
+        return m_u.empty();
+    }
+    // knots of the curve, subdivisions pieces per segment
+    void build(const Curve& curve, const std::vector<double>& knots,
+               int subdivisions);
+    double length() const
+    {
+        return m_s.back();
+    }
+    // length from the first knot to u, negative before the first knot
+    double length_at(const Curve& curve, double u) const;
+    // parameter at arc length s, and batch variant with a piece cursor
+    // carried from one point to the next, O(1) per point for increasing s
+    double param_at(const Curve& curve, double s) const;
+    void param_at(const Curve& curve, const double* s, double* u,
+                  size_t n) const;
 };
 
 
@@ -80,9 +114,13 @@ public:
 class spline
 {
 public:
+    // boundary conditions: natural and clamped splines are second_deriv
+    // and first_deriv ends; periodic must be set on both ends, needs
+    // y[0]==y[n-1] and wraps x into [x[0],x[n-1]) on evaluation
     enum bd_type {
         first_deriv = 1,
-        second_deriv = 2
+        second_deriv = 2,
+        periodic = 3
     };
 
 private:
@@ -90,10 +128,19 @@ private:
     // interpolation parameters
     // f(x) = a*(x-x_i)^3 + b*(x-x_i)^2 + c*(x-x_i) + y_i
     std::vector<double> m_a,m_b,m_c;        // spline coefficients
+    std::vector<double> m_work;             // scratch for the solver
     double  m_b0, m_c0;                     // for left extrapol
     bd_type m_left, m_right;
     double  m_left_value, m_right_value;
     bool    m_force_linear_extrapolation;
+    arc_length_table<spline> m_arc;         // built on request
+
+    friend class arc_length_table<spline>;
+    double speed(int seg, double x) const;
+    double wrap(double x) const;
+    void solve_natural(const double* x, const double* y, int n);
+    void solve_clamped(const double* x, const double* y, int n);
+    void solve_periodic(const double* x, const double* y, int n);
 
 public:
     // set default boundary condition to be zero curvature at both ends
@@ -104,13 +151,237 @@ public:
         ;
     }
 
-    // optional, but if called it has to come be before set_points()
+    // optional, but if called it has to come be before set_points(); on a
+    // spline that is refitted it applies from the next refit()
     void set_boundary(bd_type left, double left_value,
                       bd_type right, double right_value,
                       bool force_linear_extrapolation=false);
     void set_points(const std::vector<double>& x,
                     const std::vector<double>& y, bool cubic_spline=true);
+    // same as set_points(), reusing the storage of earlier fits: memory is
+    // only allocated when n exceeds every earlier n (or reserve())
+    void refit(const double* x, const double* y, int n,
+               bool cubic_spline=true);
+    void reserve(int n);
+    double operator() (double x) const;
+    double deriv(int order, double x) const;
+
+    // evaluate at n points xs[], same results as operator() and deriv();
+    // the segment is found with a cursor carried from the previous point,
+    // so increasing xs[] cost O(1) per point instead of a binary search
+    void eval_batch(const double* xs, double* ys, size_t n) const;
+    // value and first to third derivatives in one pass, any of the
+    // outputs may be NULL
+    void eval_batch(const double* xs, double* ys, double* dys,
+                    double* ddys, double* dddys, size_t n) const;
+
+    // arc length of the curve (x,f(x)), after build_arc_length(); the
+    // table is dropped by set_points(). The inverse is a table lookup and
+    // Newton steps on a single Gauss-Legendre integral, accurate to 1e-9
+    void build_arc_length(int subdivisions=8);
+    double arc_length() const;              // from first to last point
+    double arc_length(double x) const;      // from the first point to x
+    double x_at_arc_length(double s) const;
+    void x_at_arc_length(const double* s, double* xs, size_t n) const;
+};
+
+
+// parametric spline through points in the plane, x(t) and y(t) against
+// the chord length t, natural cubic splines by default; unlike y(x) it does
+// not need the points in a rotated frame and can turn back on itself
+class spline2d
+{
+public:
+    typedef spline::bd_type bd_type;
+
+private:
+    std::vector<double> m_t;                // parameter, chord length
+    std::vector<double> m_x,m_y;            // coordinates of the points
+    // x(t) = ax*(t-t_i)^3 + bx*(t-t_i)^2 + cx*(t-t_i) + x_i, same for y
+    std::vector<double> m_ax,m_bx,m_cx;
+    std::vector<double> m_ay,m_by,m_cy;
+    std::vector<double> m_work;             // scratch for the solver
+    arc_length_table<spline2d> m_arc;       // built on request
+    bd_type m_left, m_right;
+    double  m_left_dx, m_left_dy, m_right_dx, m_right_dy;
+
+    int segment(double t) const;
+    double wrap(double t) const;
+    friend class arc_length_table<spline2d>;
+    double speed(int seg, double t) const;
+
+public:
+    spline2d(): m_left(spline::second_deriv), m_right(spline::second_deriv),
+        m_left_dx(0.0), m_left_dy(0.0), m_right_dx(0.0), m_right_dy(0.0)
+    {
+        ;
+    }
+
+    // boundary conditions as for spline, with the derivative of (x,y) with
+    // respect to t at each end: for first_deriv a unit vector is the
+    // heading, as t is close to the arc length. periodic needs the first
+    // and last point equal and wraps t into [0,length()) on evaluation.
+    // Applies from the next set_points()
+    void set_boundary(bd_type left, double left_dx, double left_dy,
+                      bd_type right, double right_dx, double right_dy);
+
+    // both coordinates are fitted with one tridiagonal solve, as the
+    // system matrix only depends on the parameter
+    void set_points(const double* x, const double* y, int n);
+    void set_points(const std::vector<double>& x,
+                    const std::vector<double>& y)
+    {
+        assert(x.size()==y.size());
+        set_points(x.data(), y.data(), x.size());
+    }
+    // set_points() already reuses the storage of earlier fits, refit() is
+    // the same call under the name spline uses
+    void refit(const double* x, const double* y, int n)
+    {
+        set_points(x, y, n);
+    }
+    void reserve(int n);
+
+    // parameter of point i, and of the last point (the length of the
+    // chord polyline)
+    double param(int i) const
+    {
+        return m_t[i];
+    }
+    double length() const
+    {
+        return m_t.back();
+    }
+
+    // position and derivatives with respect to t, extrapolated linearly
+    // beyond the ends unless periodic
+    void operator() (double t, double& x, double& y) const;
+    void deriv(int order, double t, double& dx, double& dy) const;
+
+    // positions at n parameters ts[], with a segment cursor carried from
+    // one point to the next as in spline::eval_batch()
+    void eval_batch(const double* ts, double* xs, double* ys, size_t n) const;
+
+    // arc length along the curve, as for spline; t only approximates it
+    void build_arc_length(int subdivisions=8);
+    double arc_length() const;              // from first to last point
+    double arc_length(double t) const;      // from the first point to t
+    double t_at_arc_length(double s) const;
+    void t_at_arc_length(const double* s, double* ts, size_t n) const;
+};
+
+
+// pool of splines reserved for a given number of points, which planners
+// fitting many short lived splines per frame borrow instead of building
+// new ones, so fitting does not allocate once the pool is warm; borrowed
+// splines keep the boundary conditions their last user set. The pool is
+// not thread safe, use one per thread
+template<class Spline>
+class spline_pool
+{
+private:
+    std::vector<Spline*> m_all;             // owned by the pool
+    std::vector<Spline*> m_free;
+    int m_capacity;
+
+    spline_pool(const spline_pool&);
+    spline_pool& operator=(const spline_pool&);
+
+public:
+    spline_pool(int count, int capacity);
+    ~spline_pool();
+
+    // a free spline, or a new one if all are borrowed
+    Spline* acquire();
+    void release(Spline* spline);
+    int size() const
+    {
+        return m_all.size();
+    }
+    int available() const
+    {
+        return m_free.size();
+    }
+
+    // borrows a spline from the pool while in scope
+    class borrowed
+    {
+    private:
+        spline_pool& m_pool;
+        Spline* m_spline;
+        borrowed(const borrowed&);
+        borrowed& operator=(const borrowed&);
+    public:
+        explicit borrowed(spline_pool& pool): m_pool(pool),
+            m_spline(pool.acquire()) {}
+        ~borrowed()
+        {
+            m_pool.release(m_spline);
+        }
+        Spline& operator*() const
+        {
+            return *m_spline;
+        }
+        Spline* operator->() const
+        {
+            return m_spline;
+        }
+    };
+};
+
+
+// spline interpolation through a fixed number N of points, with the same
+// boundary conditions and results as spline; all storage is inline in
+// std::array and loop bounds are known at compile time, so fitting and
+// evaluation never allocate and can be fully unrolled by the compiler
+template<int N>
+class fixed_spline
+{
+    static_assert(N>2, "fixed_spline needs at least 3 points");
+
+public:
+    typedef spline::bd_type bd_type;
+
+private:
+    std::array<double,N> m_x,m_y;           // x,y coordinates of points
+    // f(x) = a*(x-x_i)^3 + b*(x-x_i)^2 + c*(x-x_i) + y_i
+    std::array<double,N> m_a,m_b,m_c;       // spline coefficients
+    double  m_b0, m_c0;                     // for left extrapol
+    bd_type m_left, m_right;
+    double  m_left_value, m_right_value;
+    bool    m_force_linear_extrapolation;
+
+    int segment(double x) const;
+    double wrap(double x) const;
+
+public:
+    // set default boundary condition to be zero curvature at both ends
+    fixed_spline(): m_left(spline::second_deriv),
+        m_right(spline::second_deriv),
+        m_left_value(0.0), m_right_value(0.0),
+        m_force_linear_extrapolation(false)
+    {
+        ;
+    }
+
+    static constexpr int size()
+    {
+        return N;
+    }
+
+    // optional, but if called it has to come be before set_points()
+    void set_boundary(bd_type left, double left_value,
+                      bd_type right, double right_value,
+                      bool force_linear_extrapolation=false);
+    void set_points(const double* x, const double* y,
+                    bool cubic_spline=true);
+    void set_points(const std::array<double,N>& x,
+                    const std::array<double,N>& y, bool cubic_spline=true)
+    {
+        set_points(x.data(), y.data(), cubic_spline);
+    }
     double operator() (double x) const;
+    double deriv(int order, double x) const;
 };
 
 
@@ -120,151 +391,191 @@ public:
 // ---------------------------------------------------------------------
 
 
-// band_matrix implementation
-// -------------------------
+// tridiagonal solvers
+// -------------------
 
-band_matrix::band_matrix(int dim, int n_u, int n_l)
-{
-    resize(dim, n_u, n_l);
-}
-void band_matrix::resize(int dim, int n_u, int n_l)
+void solve_tridiagonal(const double* sub, const double* diag,
+                       const double* sup, double* rhs, double* scratch,
+                       int n)
 {
-    assert(dim>0);
-    assert(n_u>=0);
-    assert(n_l>=0);
-    m_upper.resize(n_u+1);
-    m_lower.resize(n_l+1);
-    for(size_t i=0; i<m_upper.size(); i++) {
-        m_upper[i].resize(dim);
+    assert(n>0);
+    // forward sweep, scratch holds the modified super-diagonal
+    assert(diag[0]!=0.0);
+    scratch[0]=sup[0]/diag[0];
+    rhs[0]=rhs[0]/diag[0];
+    for(int i=1; i<n; i++) {
+        double m=diag[i]-sub[i]*scratch[i-1];
+        assert(m!=0.0);
+        scratch[i]=sup[i]/m;
+        rhs[i]=(rhs[i]-sub[i]*rhs[i-1])/m;
     }
-    for(size_t i=0; i<m_lower.size(); i++) {
-        m_lower[i].resize(dim);
+    // back substitution
+    for(int i=n-2; i>=0; i--) {
+        rhs[i]-=scratch[i]*rhs[i+1];
     }
 }
-int band_matrix::dim() const
+
+void solve_cyclic_tridiagonal(const double* sub, const double* diag,
+                              const double* sup, double* rhs,
+                              double* scratch, int n)
 {
-    if(m_upper.size()>0) {
-        return m_upper[0].size();
-    } else {
-        return 0;
+    assert(n>=3);
+    double* diag2=scratch;     // diagonal with the corners folded in
+    double* z=scratch+n;       // correction vector
+    double* work=scratch+2*n;  // scratch for the plain solves
+
+    // A = A' + u v^T with u = (gamma,0,...,0,alpha),
+    // v = (1,0,...,0,beta/gamma), where alpha and beta are the corners
+    double alpha=sup[n-1];
+    double beta=sub[0];
+    double gamma=-diag[0];
+    for(int i=0; i<n; i++) {
+        diag2[i]=diag[i];
+        z[i]=0.0;
+    }
+    diag2[0]=diag[0]-gamma;
+    diag2[n-1]=diag[n-1]-alpha*beta/gamma;
+    z[0]=gamma;
+    z[n-1]=alpha;
+
+    solve_tridiagonal(sub, diag2, sup, rhs, work, n);
+    solve_tridiagonal(sub, diag2, sup, z, work, n);
+
+    double fact=(rhs[0]+beta*rhs[n-1]/gamma)/(1.0+z[0]+beta*z[n-1]/gamma);
+    for(int i=0; i<n; i++) {
+        rhs[i]-=fact*z[i];
     }
 }
 
 
-// defines the new operator (), so that we can access the elements
-// by A(i,j), index going from i=0,...,dim()-1
-double & band_matrix::operator () (int i, int j)
+// arc_length_table implementation
+// -------------------------------
+
+// 5 point Gauss-Legendre rule on [-1,1]
+const double gauss_nodes[5]= {
+    -0.9061798459386640, -0.5384693101056831, 0.0,
+    0.5384693101056831, 0.9061798459386640
+};
+const double gauss_weights[5]= {
+    0.2369268850561891, 0.4786286704993665, 0.5688888888888889,
+    0.4786286704993665, 0.2369268850561891
+};
+
+template<class Curve>
+double arc_length_table<Curve>::integrate(const Curve& curve, int seg,
+        double u0, double u1) const
 {
-    int k=j-i;       // what band is the entry
-    assert( (i>=0) && (i<dim()) && (j>=0) && (j<dim()) );
-    assert( (-num_lower()<=k) && (k<=num_upper()) );
-    // k=0 -> diogonal, k<0 lower left part, k>0 upper right part
-    if(k>=0)   return m_upper[k][i];
-    else	    return m_lower[-k][i];
+    double mid=0.5*(u0+u1);
+    double half=0.5*(u1-u0);
+    double sum=0.0;
+    for(int k=0; k<5; k++) {
+        sum+=gauss_weights[k]*curve.speed(seg, mid+half*gauss_nodes[k]);
+    }
+    return half*sum;
 }
-double band_matrix::operator () (int i, int j) const
+
+template<class Curve>
+void arc_length_table<Curve>::build(const Curve& curve,
+                                    const std::vector<double>& knots,
+                                    int subdivisions)
 {
-    int k=j-i;       // what band is the entry
-    assert( (i>=0) && (i<dim()) && (j>=0) && (j<dim()) );
-    assert( (-num_lower()<=k) && (k<=num_upper()) );
-    // k=0 -> diogonal, k<0 lower left part, k>0 upper right part
-    if(k>=0)   return m_upper[k][i];
-    else	    return m_lower[-k][i];
+    assert(subdivisions>0);
+    int segments=knots.size()-1;
+    m_u.resize(segments*subdivisions+1);
+    m_s.resize(segments*subdivisions+1);
+    m_seg.resize(segments*subdivisions+1);
+    m_u[0]=knots[0];
+    m_s[0]=0.0;
+    int j=0;
+    for(int seg=0; seg<segments; seg++) {
+        double h=(knots[seg+1]-knots[seg])/subdivisions;
+        for(int k=0; k<subdivisions; k++) {
+            double u1=(k==subdivisions-1) ? knots[seg+1] : knots[seg]+(k+1)*h;
+            m_seg[j]=seg;
+            m_s[j+1]=m_s[j]+integrate(curve, seg, m_u[j], u1);
+            m_u[j+1]=u1;
+            j++;
+        }
+    }
+    // past the last knot the curve follows the last point's extrapolation
+    m_seg[j]=segments;
 }
-// second diag (used in LU decomposition), saved in m_lower
-double band_matrix::saved_diag(int i) const
+
+// piece holding u, the first or last piece outside the knots
+template<class Curve>
+int arc_length_table<Curve>::piece_of_param(double u) const
 {
-    assert( (i>=0) && (i<dim()) );
-    return m_lower[0][i];
+    int pieces=m_u.size()-1;
+    int j=int(std::upper_bound(m_u.begin(), m_u.end(), u)-m_u.begin())-1;
+    return std::min(std::max(j, 0), pieces-1);
 }
-double & band_matrix::saved_diag(int i)
+
+template<class Curve>
+double arc_length_table<Curve>::length_at(const Curve& curve, double u) const
 {
-    assert( (i>=0) && (i<dim()) );
-    return m_lower[0][i];
+    assert(!empty());
+    int j=piece_of_param(u);
+    int seg=(u>m_u.back()) ? m_seg.back() : m_seg[j];
+    return m_s[j]+integrate(curve, seg, m_u[j], u);
 }
 
-// LR-Decomposition of a band matrix
-void band_matrix::lu_decompose()
+// parameter at arc length s, starting from the given piece
+template<class Curve>
+double arc_length_table<Curve>::invert(const Curve& curve, double s,
+                                       int piece) const
 {
-    int  i_max,j_max;
-    int  j_min;
-    double x;
+    int j=piece;
+    double u0=m_u[j];
+    double len=m_s[j+1]-m_s[j];
+    // past the last point use the extrapolated segment
+    int seg=(s>m_s.back()) ? m_seg.back() : m_seg[j];
 
-    // preconditioning
-    // normalize column i so that a_ii=1
-    for(int i=0; i<this->dim(); i++) {
-        assert(this->operator()(i,i)!=0.0);
-        this->saved_diag(i)=1.0/this->operator()(i,i);
-        j_min=std::max(0,i-this->num_lower());
-        j_max=std::min(this->dim()-1,i+this->num_upper());
-        for(int j=j_min; j<=j_max; j++) {
-            this->operator()(i,j) *= this->saved_diag(i);
-        }
-        this->operator()(i,i)=1.0;          // prevents rounding errors
-    }
-
-    // Gauss LR-Decomposition
-    for(int k=0; k<this->dim(); k++) {
-        i_max=std::min(this->dim()-1,k+this->num_lower());  // num_lower not a mistake!
-        for(int i=k+1; i<=i_max; i++) {
-            assert(this->operator()(k,k)!=0.0);
-            x=-this->operator()(i,k)/this->operator()(k,k);
-            this->operator()(i,k)=-x;                         // assembly part of L
-            j_max=std::min(this->dim()-1,k+this->num_upper());
-            for(int j=k+1; j<=j_max; j++) {
-                // assembly part of R
-                this->operator()(i,j)=this->operator()(i,j)+x*this->operator()(k,j);
-            }
+    // the length is nearly linear in u across one piece, so linear
+    // interpolation in the table is a close start for Newton's method
+    double u=u0+(s-m_s[j])/len*(m_u[j+1]-u0);
+    for(int iter=0; iter<4; iter++) {
+        double f=m_s[j]+integrate(curve, seg, u0, u)-s;
+        u-=f/curve.speed(seg, u);
+        if(std::fabs(f)<1e-9) {
+            break;
         }
     }
+    return u;
 }
-// solves Ly=b
-std::vector<double> band_matrix::l_solve(const std::vector<double>& b) const
+
+template<class Curve>
+double arc_length_table<Curve>::param_at(const Curve& curve, double s) const
 {
-    assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
-    int j_start;
-    double sum;
-    for(int i=0; i<this->dim(); i++) {
-        sum=0;
-        j_start=std::max(0,i-this->num_lower());
-        for(int j=j_start; j<i; j++) sum += this->operator()(i,j)*x[j];
-        x[i]=(b[i]*this->saved_diag(i)) - sum;
-    }
-    return x;
-}
-// solves Rx=y
-std::vector<double> band_matrix::r_solve(const std::vector<double>& b) const
-{
-    assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
-    int j_stop;
-    double sum;
-    for(int i=this->dim()-1; i>=0; i--) {
-        sum=0;
-        j_stop=std::min(this->dim()-1,i+this->num_upper());
-        for(int j=i+1; j<=j_stop; j++) sum += this->operator()(i,j)*x[j];
-        x[i]=( b[i] - sum ) / this->operator()(i,i);
-    }
-    return x;
+    assert(!empty());
+    int pieces=m_s.size()-1;
+    int j=int(std::upper_bound(m_s.begin(), m_s.end(), s)-m_s.begin())-1;
+    return invert(curve, s, std::min(std::max(j, 0), pieces-1));
 }
 
-std::vector<double> band_matrix::lu_solve(const std::vector<double>& b,
-        bool is_lu_decomposed)
+template<class Curve>
+void arc_length_table<Curve>::param_at(const Curve& curve, const double* s,
+                                       double* u, size_t n) const
 {
-    assert( this->dim()==(int)b.size() );
-    std::vector<double>  x,y;
-    if(is_lu_decomposed==false) {
-        this->lu_decompose();
+    assert(!empty());
+    const int pieces=m_s.size()-1;
+    const double* ms=m_s.data();
+    int j=0;
+    for(size_t k=0; k<n; k++) {
+        // walk the cursor forward if s is at most 8 pieces ahead, else
+        // binary search, as in spline::eval_batch()
+        if((j>0 && ms[j]>s[k]) || (j+8<pieces && ms[j+8]<=s[k])) {
+            j=int(std::upper_bound(ms, ms+pieces+1, s[k])-ms)-1;
+            j=std::min(std::max(j, 0), pieces-1);
+        } else {
+            while(j<pieces-1 && ms[j+1]<=s[k]) {
+                j++;
+            }
+        }
+        u[k]=invert(curve, s[k], j);
     }
-    y=this->l_solve(b);
-    x=this->r_solve(y);
-    return x;
 }
 
 
-
-
 // spline implementation
 // -----------------------
 
@@ -272,7 +583,6 @@ void spline::set_boundary(spline::bd_type left, double left_value,
                           spline::bd_type right, double right_value,
                           bool force_linear_extrapolation)
 {
-    assert(m_x.size()==0);          // set_points() must not have happened yet
     m_left=left;
     m_right=right;
     m_left_value=left_value;
@@ -285,63 +595,48 @@ void spline::set_points(const std::vector<double>& x,
                         const std::vector<double>& y, bool cubic_spline)
 {
     assert(x.size()==y.size());
-    assert(x.size()>2);
-    m_x=x;
-    m_y=y;
-    int   n=x.size();
+    refit(x.data(), y.data(), x.size(), cubic_spline);
+}
+
+void spline::reserve(int n)
+{
+    m_x.reserve(n);
+    m_y.reserve(n);
+    m_a.reserve(n);
+    m_b.reserve(n);
+    m_c.reserve(n);
+    m_work.reserve(4*n);
+    m_arc.reserve(n, 8);
+}
+
+void spline::refit(const double* x, const double* y, int n,
+                   bool cubic_spline)
+{
+    assert(n>2);
+    m_x.assign(x, x+n);
+    m_y.assign(y, y+n);
+    m_arc.clear();
     // TODO: maybe sort x and y, rather than returning an error
     for(int i=0; i<n-1; i++) {
         assert(m_x[i]<m_x[i+1]);
     }
 
     if(cubic_spline==true) { // cubic spline interpolation
-        // setting up the matrix and right hand side of the equation system
-        // for the parameters b[]
-        band_matrix A(n,1,1);
-        std::vector<double>  rhs(n);
-        for(int i=1; i<n-1; i++) {
-            A(i,i-1)=1.0/3.0*(x[i]-x[i-1]);
-            A(i,i)=2.0/3.0*(x[i+1]-x[i-1]);
-            A(i,i+1)=1.0/3.0*(x[i+1]-x[i]);
-            rhs[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
-        }
-        // boundary conditions
-        if(m_left == spline::second_deriv) {
-            // 2*b[0] = f''
-            A(0,0)=2.0;
-            A(0,1)=0.0;
-            rhs[0]=m_left_value;
-        } else if(m_left == spline::first_deriv) {
-            // c[0] = f', needs to be re-expressed in terms of b:
-            // (2b[0]+b[1])(x[1]-x[0]) = 3 ((y[1]-y[0])/(x[1]-x[0]) - f')
-            A(0,0)=2.0*(x[1]-x[0]);
-            A(0,1)=1.0*(x[1]-x[0]);
-            rhs[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
-        } else {
-            assert(false);
-        }
-        if(m_right == spline::second_deriv) {
-            // 2*b[n-1] = f''
-            A(n-1,n-1)=2.0;
-            A(n-1,n-2)=0.0;
-            rhs[n-1]=m_right_value;
-        } else if(m_right == spline::first_deriv) {
-            // c[n-1] = f', needs to be re-expressed in terms of b:
-            // (b[n-2]+2b[n-1])(x[n-1]-x[n-2])
-            // = 3 (f' - (y[n-1]-y[n-2])/(x[n-1]-x[n-2]))
-            A(n-1,n-1)=2.0*(x[n-1]-x[n-2]);
-            A(n-1,n-2)=1.0*(x[n-1]-x[n-2]);
-            rhs[n-1]=3.0*(m_right_value-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
+        // solve the tridiagonal equation system for the parameters b[],
+        // with a solver specialised for the boundary conditions
+        m_a.resize(n);
+        m_b.resize(n);
+        m_c.resize(n);
+        if(m_left==spline::periodic || m_right==spline::periodic) {
+            solve_periodic(x, y, n);
+        } else if(m_left==spline::second_deriv &&
+                  m_right==spline::second_deriv) {
+            solve_natural(x, y, n);
         } else {
-            assert(false);
+            solve_clamped(x, y, n);
         }
 
-        // solve the equation system to obtain the parameters b[]
-        m_b=A.lu_solve(rhs);
-
         // calculate parameters a[] and c[] based on b[]
-        m_a.resize(n);
-        m_c.resize(n);
         for(int i=0; i<n-1; i++) {
             m_a[i]=1.0/3.0*(m_b[i+1]-m_b[i])/(x[i+1]-x[i]);
             m_c[i]=(y[i+1]-y[i])/(x[i+1]-x[i])
@@ -356,6 +651,10 @@ void spline::set_points(const std::vector<double>& x,
             m_b[i]=0.0;
             m_c[i]=(m_y[i+1]-m_y[i])/(m_x[i+1]-m_x[i]);
         }
+        // resize() keeps the coefficients of an earlier fit
+        m_a[n-1]=0.0;
+        m_b[n-1]=0.0;
+        m_c[n-1]=0.0;
     }
 
     // for left extrapolation coefficients
@@ -372,8 +671,114 @@ void spline::set_points(const std::vector<double>& x,
         m_b[n-1]=0.0;
 }
 
+// the systems below are set up with the sub-diagonal in m_a, the diagonal
+// in m_work, the super-diagonal in m_c and the right hand side in m_b,
+// which the solver overwrites with b[]
+
+// both ends second_deriv: b[0] and b[n-1] are known, so only the n-2
+// interior unknowns are solved for
+void spline::solve_natural(const double* x, const double* y, int n)
+{
+    m_work.resize(2*n);
+    double* diag=m_work.data();
+    m_b[0]=0.5*m_left_value;
+    m_b[n-1]=0.5*m_right_value;
+    for(int i=1; i<n-1; i++) {
+        m_a[i]=1.0/3.0*(x[i]-x[i-1]);
+        diag[i]=2.0/3.0*(x[i+1]-x[i-1]);
+        m_c[i]=1.0/3.0*(x[i+1]-x[i]);
+        m_b[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
+    }
+    m_b[1]-=m_a[1]*m_b[0];
+    m_b[n-2]-=m_c[n-2]*m_b[n-1];
+    solve_tridiagonal(m_a.data()+1, diag+1, m_c.data()+1, m_b.data()+1,
+                      diag+n, n-2);
+}
+
+// general ends, at least one first_deriv: full system with one boundary
+// row each
+void spline::solve_clamped(const double* x, const double* y, int n)
+{
+    m_work.resize(2*n);
+    double* diag=m_work.data();
+    for(int i=1; i<n-1; i++) {
+        m_a[i]=1.0/3.0*(x[i]-x[i-1]);
+        diag[i]=2.0/3.0*(x[i+1]-x[i-1]);
+        m_c[i]=1.0/3.0*(x[i+1]-x[i]);
+        m_b[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
+    }
+    // boundary conditions
+    if(m_left == spline::second_deriv) {
+        // 2*b[0] = f''
+        diag[0]=2.0;
+        m_c[0]=0.0;
+        m_b[0]=m_left_value;
+    } else if(m_left == spline::first_deriv) {
+        // c[0] = f', needs to be re-expressed in terms of b:
+        // (2b[0]+b[1])(x[1]-x[0]) = 3 ((y[1]-y[0])/(x[1]-x[0]) - f')
+        diag[0]=2.0*(x[1]-x[0]);
+        m_c[0]=1.0*(x[1]-x[0]);
+        m_b[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
+    } else {
+        assert(false);
+    }
+    if(m_right == spline::second_deriv) {
+        // 2*b[n-1] = f''
+        diag[n-1]=2.0;
+        m_a[n-1]=0.0;
+        m_b[n-1]=m_right_value;
+    } else if(m_right == spline::first_deriv) {
+        // c[n-1] = f', needs to be re-expressed in terms of b:
+        // (b[n-2]+2b[n-1])(x[n-1]-x[n-2])
+        // = 3 (f' - (y[n-1]-y[n-2])/(x[n-1]-x[n-2]))
+        diag[n-1]=2.0*(x[n-1]-x[n-2]);
+        m_a[n-1]=1.0*(x[n-1]-x[n-2]);
+        m_b[n-1]=3.0*(m_right_value-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
+    } else {
+        assert(false);
+    }
+    solve_tridiagonal(m_a.data(), diag, m_c.data(), m_b.data(), diag+n, n);
+}
+
+// periodic: point n-1 is point 0 again, so the n-1 unknowns b[0..n-2]
+// form a cyclic system whose first and last rows wrap around
+void spline::solve_periodic(const double* x, const double* y, int n)
+{
+    assert(m_left==spline::periodic && m_right==spline::periodic);
+    assert(y[0]==y[n-1]);
+    assert(n>=4);
+    int m=n-1;
+    m_work.resize(4*n);
+    double* diag=m_work.data();
+    for(int i=0; i<m; i++) {
+        // segment before point i, wrapping to the last one for i=0
+        double h_prev=(i>0) ? x[i]-x[i-1] : x[n-1]-x[n-2];
+        double y_prev=(i>0) ? y[i-1] : y[n-2];
+        double h=x[i+1]-x[i];
+        m_a[i]=1.0/3.0*h_prev;
+        diag[i]=2.0/3.0*(h_prev+h);
+        m_c[i]=1.0/3.0*h;
+        m_b[i]=(y[i+1]-y[i])/h - (y[i]-y_prev)/h_prev;
+    }
+    solve_cyclic_tridiagonal(m_a.data(), diag, m_c.data(), m_b.data(),
+                             diag+n, m);
+    m_b[n-1]=m_b[0];
+}
+
+// x wrapped into [x[0],x[n-1]) for periodic splines
+double spline::wrap(double x) const
+{
+    if(m_left!=spline::periodic) {
+        return x;
+    }
+    double x0=m_x[0];
+    double period=m_x.back()-x0;
+    return x-period*std::floor((x-x0)/period);
+}
+
 double spline::operator() (double x) const
 {
+    x=wrap(x);
     size_t n=m_x.size();
     // find the closest point m_x[idx] < x, idx=0 even if x<m_x[0]
     std::vector<double>::const_iterator it;
@@ -395,6 +800,741 @@ double spline::operator() (double x) const
     return interpol;
 }
 
+double spline::deriv(int order, double x) const
+{
+    assert(order>0);
+    x=wrap(x);
+
+    size_t n=m_x.size();
+    // find the closest point m_x[idx] < x, idx=0 even if x<m_x[0]
+    std::vector<double>::const_iterator it;
+    it=std::lower_bound(m_x.begin(),m_x.end(),x);
+    int idx=std::max( int(it-m_x.begin())-1, 0);
+
+    double h=x-m_x[idx];
+    double interpol;
+    if(x<m_x[0]) {
+        // extrapolation to the left
+        switch(order) {
+        case 1:
+            interpol=2.0*m_b0*h + m_c0;
+            break;
+        case 2:
+            interpol=2.0*m_b0;
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    } else if(x>m_x[n-1]) {
+        // extrapolation to the right
+        switch(order) {
+        case 1:
+            interpol=2.0*m_b[n-1]*h + m_c[n-1];
+            break;
+        case 2:
+            interpol=2.0*m_b[n-1];
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    } else {
+        // interpolation
+        switch(order) {
+        case 1:
+            interpol=(3.0*m_a[idx]*h + 2.0*m_b[idx])*h + m_c[idx];
+            break;
+        case 2:
+            interpol=6.0*m_a[idx]*h + 2.0*m_b[idx];
+            break;
+        case 3:
+            interpol=6.0*m_a[idx];
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    }
+    return interpol;
+}
+
+void spline::eval_batch(const double* xs, double* ys, size_t n) const
+{
+    eval_batch(xs, ys, NULL, NULL, NULL, n);
+}
+
+void spline::eval_batch(const double* xs, double* ys, double* dys,
+                        double* ddys, double* dddys, size_t n) const
+{
+    // points are done in blocks: first the segment search and a gather of
+    // the segment coefficients, which is scalar, then the polynomial
+    // evaluation as straight loops the compiler can vectorize
+    const size_t block=64;
+    double a[block], b[block], c[block], y[block], h[block];
+    const int size=m_x.size();
+    const double* mx=m_x.data();
+    int idx=0;
+
+    for(size_t start=0; start<n; start+=block) {
+        size_t count=std::min(block, n-start);
+        for(size_t k=0; k<count; k++) {
+            double x=wrap(xs[start+k]);
+            // closest point m_x[idx] < x as in operator(): walk the cursor
+            // forward if x is at most 8 points ahead, else binary search
+            if((idx>0 && mx[idx]>=x) || (idx+8<size && mx[idx+8]<x)) {
+                idx=std::max(int(std::lower_bound(mx, mx+size, x)-mx)-1, 0);
+            } else {
+                while(idx<size-1 && mx[idx+1]<x) {
+                    idx++;
+                }
+            }
+            h[k]=x-mx[idx];
+            if(x<mx[0]) {
+                // extrapolation to the left, a quadratic
+                a[k]=0.0;
+                b[k]=m_b0;
+                c[k]=m_c0;
+            } else {
+                // interpolation, or extrapolation to the right with
+                // m_a[n-1]=0
+                a[k]=m_a[idx];
+                b[k]=m_b[idx];
+                c[k]=m_c[idx];
+            }
+            y[k]=m_y[idx];
+        }
+
+        if(ys!=NULL) {
+            double* out=ys+start;
+            for(size_t k=0; k<count; k++) {
+                out[k]=((a[k]*h[k] + b[k])*h[k] + c[k])*h[k] + y[k];
+            }
+        }
+        if(dys!=NULL) {
+            double* out=dys+start;
+            for(size_t k=0; k<count; k++) {
+                out[k]=(3.0*a[k]*h[k] + 2.0*b[k])*h[k] + c[k];
+            }
+        }
+        if(ddys!=NULL) {
+            double* out=ddys+start;
+            for(size_t k=0; k<count; k++) {
+                out[k]=6.0*a[k]*h[k] + 2.0*b[k];
+            }
+        }
+        if(dddys!=NULL) {
+            double* out=dddys+start;
+            for(size_t k=0; k<count; k++) {
+                out[k]=6.0*a[k];
+            }
+        }
+    }
+}
+
+
+// slope of the spline as in deriv(1,x), on a known segment
+double spline::speed(int seg, double x) const
+{
+    double slope;
+    if(x<m_x[0]) {
+        double h=x-m_x[0];
+        slope=2.0*m_b0*h + m_c0;
+    } else {
+        double h=x-m_x[seg];
+        slope=(3.0*m_a[seg]*h + 2.0*m_b[seg])*h + m_c[seg];
+    }
+    return std::sqrt(1.0+slope*slope);
+}
+
+void spline::build_arc_length(int subdivisions)
+{
+    m_arc.build(*this, m_x, subdivisions);
+}
+
+double spline::arc_length() const
+{
+    assert(!m_arc.empty());
+    return m_arc.length();
+}
+
+double spline::arc_length(double x) const
+{
+    return m_arc.length_at(*this, x);
+}
+
+double spline::x_at_arc_length(double s) const
+{
+    return m_arc.param_at(*this, s);
+}
+
+void spline::x_at_arc_length(const double* s, double* xs, size_t n) const
+{
+    m_arc.param_at(*this, s, xs, n);
+}
+
+
+// spline2d implementation
+// -----------------------
+
+void spline2d::set_points(const double* x, const double* y, int n)
+{
+    assert(n>2);
+    m_t.resize(n);
+    m_x.assign(x, x+n);
+    m_arc.clear();
+    m_y.assign(y, y+n);
+    m_ax.resize(n);
+    m_bx.resize(n);
+    m_cx.resize(n);
+    m_ay.resize(n);
+    m_by.resize(n);
+    m_cy.resize(n);
+    m_work.resize(4*n);
+
+    m_t[0]=0.0;
+    for(int i=1; i<n; i++) {
+        m_t[i]=m_t[i-1]+std::sqrt((x[i]-x[i-1])*(x[i]-x[i-1])+
+                                  (y[i]-y[i-1])*(y[i]-y[i-1]));
+        assert(m_t[i]>m_t[i-1]);
+    }
+    const double* t=m_t.data();
+
+    // spline system as in spline::set_points(), sub-diagonal in m_ax,
+    // diagonal in m_work, super-diagonal in m_cx and the two right hand
+    // sides in m_bx and m_by
+    double* diag=m_work.data();
+    double* scratch=diag+n;
+    if(m_left==spline::periodic || m_right==spline::periodic) {
+        // cyclic system over the n-1 distinct points, as in
+        // spline::solve_periodic(), solved once per coordinate
+        assert(m_left==spline::periodic && m_right==spline::periodic);
+        assert(x[0]==x[n-1] && y[0]==y[n-1]);
+        assert(n>=4);
+        int m=n-1;
+        for(int i=0; i<m; i++) {
+            double h_prev=(i>0) ? t[i]-t[i-1] : t[n-1]-t[n-2];
+            double x_prev=(i>0) ? x[i-1] : x[n-2];
+            double y_prev=(i>0) ? y[i-1] : y[n-2];
+            double h=t[i+1]-t[i];
+            m_ax[i]=1.0/3.0*h_prev;
+            diag[i]=2.0/3.0*(h_prev+h);
+            m_cx[i]=1.0/3.0*h;
+            m_bx[i]=(x[i+1]-x[i])/h - (x[i]-x_prev)/h_prev;
+            m_by[i]=(y[i+1]-y[i])/h - (y[i]-y_prev)/h_prev;
+        }
+        solve_cyclic_tridiagonal(m_ax.data(), diag, m_cx.data(), m_bx.data(),
+                                 scratch, m);
+        solve_cyclic_tridiagonal(m_ax.data(), diag, m_cx.data(), m_by.data(),
+                                 scratch, m);
+        m_bx[n-1]=m_bx[0];
+        m_by[n-1]=m_by[0];
+    } else {
+        for(int i=1; i<n-1; i++) {
+            m_ax[i]=1.0/3.0*(t[i]-t[i-1]);
+            diag[i]=2.0/3.0*(t[i+1]-t[i-1]);
+            m_cx[i]=1.0/3.0*(t[i+1]-t[i]);
+            m_bx[i]=(x[i+1]-x[i])/(t[i+1]-t[i]) - (x[i]-x[i-1])/(t[i]-t[i-1]);
+            m_by[i]=(y[i+1]-y[i])/(t[i+1]-t[i]) - (y[i]-y[i-1])/(t[i]-t[i-1]);
+        }
+        // boundary rows, see spline::solve_clamped()
+        double h0=t[1]-t[0];
+        double h1=t[n-1]-t[n-2];
+        if(m_left==spline::first_deriv) {
+            diag[0]=2.0*h0;
+            m_cx[0]=h0;
+            m_bx[0]=3.0*((x[1]-x[0])/h0-m_left_dx);
+            m_by[0]=3.0*((y[1]-y[0])/h0-m_left_dy);
+        } else {
+            diag[0]=2.0;
+            m_cx[0]=0.0;
+            m_bx[0]=m_left_dx;
+            m_by[0]=m_left_dy;
+        }
+        if(m_right==spline::first_deriv) {
+            diag[n-1]=2.0*h1;
+            m_ax[n-1]=h1;
+            m_bx[n-1]=3.0*(m_right_dx-(x[n-1]-x[n-2])/h1);
+            m_by[n-1]=3.0*(m_right_dy-(y[n-1]-y[n-2])/h1);
+        } else {
+            diag[n-1]=2.0;
+            m_ax[n-1]=0.0;
+            m_bx[n-1]=m_right_dx;
+            m_by[n-1]=m_right_dy;
+        }
+
+        // Thomas algorithm with both right hand sides in one sweep
+        scratch[0]=m_cx[0]/diag[0];
+        m_bx[0]=m_bx[0]/diag[0];
+        m_by[0]=m_by[0]/diag[0];
+        for(int i=1; i<n; i++) {
+            double m=diag[i]-m_ax[i]*scratch[i-1];
+            assert(m!=0.0);
+            scratch[i]=m_cx[i]/m;
+            m_bx[i]=(m_bx[i]-m_ax[i]*m_bx[i-1])/m;
+            m_by[i]=(m_by[i]-m_ax[i]*m_by[i-1])/m;
+        }
+        for(int i=n-2; i>=0; i--) {
+            m_bx[i]-=scratch[i]*m_bx[i+1];
+            m_by[i]-=scratch[i]*m_by[i+1];
+        }
+    }
+
+    // calculate parameters a[] and c[] based on b[]
+    for(int i=0; i<n-1; i++) {
+        double h=t[i+1]-t[i];
+        m_ax[i]=1.0/3.0*(m_bx[i+1]-m_bx[i])/h;
+        m_cx[i]=(x[i+1]-x[i])/h - 1.0/3.0*(2.0*m_bx[i]+m_bx[i+1])*h;
+        m_ay[i]=1.0/3.0*(m_by[i+1]-m_by[i])/h;
+        m_cy[i]=(y[i+1]-y[i])/h - 1.0/3.0*(2.0*m_by[i]+m_by[i+1])*h;
+    }
+
+    // the last point carries the slope at the end, for linear
+    // extrapolation
+    double h=t[n-1]-t[n-2];
+    m_ax[n-1]=0.0;
+    m_bx[n-1]=0.0;
+    m_cx[n-1]=3.0*m_ax[n-2]*h*h+2.0*m_bx[n-2]*h+m_cx[n-2];
+    m_ay[n-1]=0.0;
+    m_by[n-1]=0.0;
+    m_cy[n-1]=3.0*m_ay[n-2]*h*h+2.0*m_by[n-2]*h+m_cy[n-2];
+}
+
+void spline2d::set_boundary(bd_type left, double left_dx, double left_dy,
+                            bd_type right, double right_dx, double right_dy)
+{
+    m_left=left;
+    m_right=right;
+    m_left_dx=left_dx;
+    m_left_dy=left_dy;
+    m_right_dx=right_dx;
+    m_right_dy=right_dy;
+}
+
+// t wrapped into [0,length()) for periodic splines
+double spline2d::wrap(double t) const
+{
+    if(m_left!=spline::periodic) {
+        return t;
+    }
+    double period=m_t.back();
+    return t-period*std::floor(t/period);
+}
+
+void spline2d::reserve(int n)
+{
+    m_t.reserve(n);
+    m_x.reserve(n);
+    m_y.reserve(n);
+    m_ax.reserve(n);
+    m_bx.reserve(n);
+    m_cx.reserve(n);
+    m_ay.reserve(n);
+    m_by.reserve(n);
+    m_cy.reserve(n);
+    m_work.reserve(4*n);
+    m_arc.reserve(n, 8);
+}
+
+// index of the closest point m_t[idx] < t, idx=0 even if t<m_t[0]
+int spline2d::segment(double t) const
+{
+    std::vector<double>::const_iterator it;
+    it=std::lower_bound(m_t.begin(),m_t.end(),t);
+    return std::max( int(it-m_t.begin())-1, 0);
+}
+
+void spline2d::operator() (double t, double& x, double& y) const
+{
+    t=wrap(t);
+    int idx=segment(t);
+    double h=t-m_t[idx];
+    if(t<m_t[0]) {
+        // linear extrapolation to the left
+        x=m_cx[0]*h + m_x[0];
+        y=m_cy[0]*h + m_y[0];
+    } else {
+        // a[n-1] and b[n-1] are 0, so the last point also extrapolates
+        // linearly to the right
+        x=((m_ax[idx]*h + m_bx[idx])*h + m_cx[idx])*h + m_x[idx];
+        y=((m_ay[idx]*h + m_by[idx])*h + m_cy[idx])*h + m_y[idx];
+    }
+}
+
+void spline2d::deriv(int order, double t, double& dx, double& dy) const
+{
+    assert(order>0);
+    t=wrap(t);
+    int idx=segment(t);
+    double h=t-m_t[idx];
+    if(t<m_t[0] || order>3) {
+        // linear extrapolation to the left
+        dx=(order==1) ? m_cx[0] : 0.0;
+        dy=(order==1) ? m_cy[0] : 0.0;
+    } else if(order==1) {
+        dx=(3.0*m_ax[idx]*h + 2.0*m_bx[idx])*h + m_cx[idx];
+        dy=(3.0*m_ay[idx]*h + 2.0*m_by[idx])*h + m_cy[idx];
+    } else if(order==2) {
+        dx=6.0*m_ax[idx]*h + 2.0*m_bx[idx];
+        dy=6.0*m_ay[idx]*h + 2.0*m_by[idx];
+    } else {
+        dx=6.0*m_ax[idx];
+        dy=6.0*m_ay[idx];
+    }
+}
+
+void spline2d::eval_batch(const double* ts, double* xs, double* ys,
+                          size_t n) const
+{
+    // gather the segment coefficients for a block of points, then
+    // evaluate both polynomials in straight loops, as in spline::eval_batch
+    const size_t block=64;
+    double h[block];
+    double ax[block], bx[block], cx[block], x0[block];
+    double ay[block], by[block], cy[block], y0[block];
+    const int size=m_t.size();
+    const double* mt=m_t.data();
+    int idx=0;
+
+    for(size_t start=0; start<n; start+=block) {
+        size_t count=std::min(block, n-start);
+        for(size_t k=0; k<count; k++) {
+            double t=wrap(ts[start+k]);
+            if((idx>0 && mt[idx]>=t) || (idx+8<size && mt[idx+8]<t)) {
+                idx=std::max(int(std::lower_bound(mt, mt+size, t)-mt)-1, 0);
+            } else {
+                while(idx<size-1 && mt[idx+1]<t) {
+                    idx++;
+                }
+            }
+            // a=b=0 extrapolates linearly to the left
+            double inside=(t<mt[0]) ? 0.0 : 1.0;
+            h[k]=t-mt[idx];
+            ax[k]=inside*m_ax[idx];
+            bx[k]=inside*m_bx[idx];
+            cx[k]=m_cx[idx];
+            x0[k]=m_x[idx];
+            ay[k]=inside*m_ay[idx];
+            by[k]=inside*m_by[idx];
+            cy[k]=m_cy[idx];
+            y0[k]=m_y[idx];
+        }
+
+        double* out_x=xs+start;
+        double* out_y=ys+start;
+        for(size_t k=0; k<count; k++) {
+            out_x[k]=((ax[k]*h[k] + bx[k])*h[k] + cx[k])*h[k] + x0[k];
+            out_y[k]=((ay[k]*h[k] + by[k])*h[k] + cy[k])*h[k] + y0[k];
+        }
+    }
+}
+
+
+// length of the tangent (dx/dt,dy/dt), on a known segment
+double spline2d::speed(int seg, double t) const
+{
+    double dx, dy;
+    if(t<m_t[0]) {
+        dx=m_cx[0];
+        dy=m_cy[0];
+    } else {
+        double h=t-m_t[seg];
+        dx=(3.0*m_ax[seg]*h + 2.0*m_bx[seg])*h + m_cx[seg];
+        dy=(3.0*m_ay[seg]*h + 2.0*m_by[seg])*h + m_cy[seg];
+    }
+    return std::sqrt(dx*dx+dy*dy);
+}
+
+void spline2d::build_arc_length(int subdivisions)
+{
+    m_arc.build(*this, m_t, subdivisions);
+}
+
+double spline2d::arc_length() const
+{
+    assert(!m_arc.empty());
+    return m_arc.length();
+}
+
+double spline2d::arc_length(double t) const
+{
+    return m_arc.length_at(*this, t);
+}
+
+double spline2d::t_at_arc_length(double s) const
+{
+    return m_arc.param_at(*this, s);
+}
+
+void spline2d::t_at_arc_length(const double* s, double* ts, size_t n) const
+{
+    m_arc.param_at(*this, s, ts, n);
+}
+
+
+// spline_pool implementation
+// --------------------------
+
+template<class Spline>
+spline_pool<Spline>::spline_pool(int count, int capacity):
+    m_capacity(capacity)
+{
+    m_all.reserve(count);
+    m_free.reserve(count);
+    for(int i=0; i<count; i++) {
+        Spline* spline=new Spline;
+        spline->reserve(capacity);
+        m_all.push_back(spline);
+        m_free.push_back(spline);
+    }
+}
+
+template<class Spline>
+spline_pool<Spline>::~spline_pool()
+{
+    assert(m_free.size()==m_all.size());    // every spline was released
+    for(size_t i=0; i<m_all.size(); i++) {
+        delete m_all[i];
+    }
+}
+
+template<class Spline>
+Spline* spline_pool<Spline>::acquire()
+{
+    if(m_free.empty()) {
+        Spline* spline=new Spline;
+        spline->reserve(m_capacity);
+        m_all.push_back(spline);
+        m_free.reserve(m_all.size());
+        return spline;
+    }
+    Spline* spline=m_free.back();
+    m_free.pop_back();
+    return spline;
+}
+
+template<class Spline>
+void spline_pool<Spline>::release(Spline* spline)
+{
+    m_free.push_back(spline);
+}
+
+
+// fixed_spline implementation
+// ---------------------------
+
+template<int N>
+void fixed_spline<N>::set_boundary(bd_type left, double left_value,
+                                   bd_type right, double right_value,
+                                   bool force_linear_extrapolation)
+{
+    m_left=left;
+    m_right=right;
+    m_left_value=left_value;
+    m_right_value=right_value;
+    m_force_linear_extrapolation=force_linear_extrapolation;
+}
+
+template<int N>
+void fixed_spline<N>::set_points(const double* x, const double* y,
+                                 bool cubic_spline)
+{
+    for(int i=0; i<N; i++) {
+        m_x[i]=x[i];
+        m_y[i]=y[i];
+    }
+    for(int i=0; i<N-1; i++) {
+        assert(m_x[i]<m_x[i+1]);
+    }
+
+    if(cubic_spline==true) { // cubic spline interpolation
+        // same tridiagonal systems as spline::set_points(), with the
+        // sub-diagonal in m_a, the super-diagonal in m_c and the right hand
+        // side in m_b
+        std::array<double,N> diag;
+        std::array<double,3*N> scratch;
+        if(m_left==spline::periodic || m_right==spline::periodic) {
+            // cyclic system, see spline::solve_periodic()
+            assert(m_left==spline::periodic && m_right==spline::periodic);
+            assert(y[0]==y[N-1]);
+            assert(N>=4);
+            for(int i=0; i<N-1; i++) {
+                double h_prev=(i>0) ? x[i]-x[i-1] : x[N-1]-x[N-2];
+                double y_prev=(i>0) ? y[i-1] : y[N-2];
+                double h=x[i+1]-x[i];
+                m_a[i]=1.0/3.0*h_prev;
+                diag[i]=2.0/3.0*(h_prev+h);
+                m_c[i]=1.0/3.0*h;
+                m_b[i]=(y[i+1]-y[i])/h - (y[i]-y_prev)/h_prev;
+            }
+            solve_cyclic_tridiagonal(m_a.data(), diag.data(), m_c.data(),
+                                     m_b.data(), scratch.data(), N-1);
+            m_b[N-1]=m_b[0];
+        } else {
+            for(int i=1; i<N-1; i++) {
+                m_a[i]=1.0/3.0*(x[i]-x[i-1]);
+                diag[i]=2.0/3.0*(x[i+1]-x[i-1]);
+                m_c[i]=1.0/3.0*(x[i+1]-x[i]);
+                m_b[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
+            }
+            // boundary conditions
+            if(m_left == spline::second_deriv) {
+                diag[0]=2.0;
+                m_c[0]=0.0;
+                m_b[0]=m_left_value;
+            } else if(m_left == spline::first_deriv) {
+                diag[0]=2.0*(x[1]-x[0]);
+                m_c[0]=1.0*(x[1]-x[0]);
+                m_b[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
+            } else {
+                assert(false);
+            }
+            if(m_right == spline::second_deriv) {
+                diag[N-1]=2.0;
+                m_a[N-1]=0.0;
+                m_b[N-1]=m_right_value;
+            } else if(m_right == spline::first_deriv) {
+                diag[N-1]=2.0*(x[N-1]-x[N-2]);
+                m_a[N-1]=1.0*(x[N-1]-x[N-2]);
+                m_b[N-1]=3.0*(m_right_value-(y[N-1]-y[N-2])/(x[N-1]-x[N-2]));
+            } else {
+                assert(false);
+            }
+
+            solve_tridiagonal(m_a.data(), diag.data(), m_c.data(), m_b.data(),
+                              scratch.data(), N);
+        }
+
+        // calculate parameters a[] and c[] based on b[]
+        for(int i=0; i<N-1; i++) {
+            m_a[i]=1.0/3.0*(m_b[i+1]-m_b[i])/(x[i+1]-x[i]);
+            m_c[i]=(y[i+1]-y[i])/(x[i+1]-x[i])
+                   - 1.0/3.0*(2.0*m_b[i]+m_b[i+1])*(x[i+1]-x[i]);
+        }
+    } else { // linear interpolation
+        for(int i=0; i<N-1; i++) {
+            m_a[i]=0.0;
+            m_b[i]=0.0;
+            m_c[i]=(m_y[i+1]-m_y[i])/(m_x[i+1]-m_x[i]);
+        }
+        // std::array is not zeroed, unlike the vectors of spline
+        m_a[N-1]=0.0;
+        m_b[N-1]=0.0;
+        m_c[N-1]=0.0;
+    }
+
+    // for left extrapolation coefficients
+    m_b0 = (m_force_linear_extrapolation==false) ? m_b[0] : 0.0;
+    m_c0 = m_c[0];
+
+    // for the right extrapolation coefficients
+    double h=x[N-1]-x[N-2];
+    m_a[N-1]=0.0;
+    m_c[N-1]=3.0*m_a[N-2]*h*h+2.0*m_b[N-2]*h+m_c[N-2];   // = f'_{N-2}(x_{N-1})
+    if(m_force_linear_extrapolation==true)
+        m_b[N-1]=0.0;
+}
+
+// index of the closest point m_x[idx] < x, idx=0 even if x<m_x[0]; a
+// branchless count over the points instead of a binary search, which is
+// faster for the small N this class is meant for
+template<int N>
+int fixed_spline<N>::segment(double x) const
+{
+    int idx=0;
+    for(int i=1; i<N; i++) {
+        idx+=(m_x[i]<x);
+    }
+    return idx;
+}
+
+// x wrapped into [x[0],x[N-1]) for periodic splines
+template<int N>
+double fixed_spline<N>::wrap(double x) const
+{
+    if(m_left!=spline::periodic) {
+        return x;
+    }
+    double x0=m_x[0];
+    double period=m_x[N-1]-x0;
+    return x-period*std::floor((x-x0)/period);
+}
+
+template<int N>
+double fixed_spline<N>::operator() (double x) const
+{
+    x=wrap(x);
+    int idx=segment(x);
+    double h=x-m_x[idx];
+    double interpol;
+    if(x<m_x[0]) {
+        // extrapolation to the left
+        interpol=(m_b0*h + m_c0)*h + m_y[0];
+    } else if(x>m_x[N-1]) {
+        // extrapolation to the right
+        interpol=(m_b[N-1]*h + m_c[N-1])*h + m_y[N-1];
+    } else {
+        // interpolation
+        interpol=((m_a[idx]*h + m_b[idx])*h + m_c[idx])*h + m_y[idx];
+    }
+    return interpol;
+}
+
+template<int N>
+double fixed_spline<N>::deriv(int order, double x) const
+{
+    assert(order>0);
+    x=wrap(x);
+
+    int idx=segment(x);
+    double h=x-m_x[idx];
+    double interpol;
+    if(x<m_x[0]) {
+        // extrapolation to the left
+        switch(order) {
+        case 1:
+            interpol=2.0*m_b0*h + m_c0;
+            break;
+        case 2:
+            interpol=2.0*m_b0;
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    } else if(x>m_x[N-1]) {
+        // extrapolation to the right
+        switch(order) {
+        case 1:
+            interpol=2.0*m_b[N-1]*h + m_c[N-1];
+            break;
+        case 2:
+            interpol=2.0*m_b[N-1];
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    } else {
+        // interpolation
+        switch(order) {
+        case 1:
+            interpol=(3.0*m_a[idx]*h + 2.0*m_b[idx])*h + m_c[idx];
+            break;
+        case 2:
+            interpol=6.0*m_a[idx]*h + 2.0*m_b[idx];
+            break;
+        case 3:
+            interpol=6.0*m_a[idx];
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    }
+    return interpol;
+}
+
 
 } // namespace tk
 
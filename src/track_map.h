@@ -0,0 +1,258 @@
+#ifndef TRACK_MAP_H
+#define TRACK_MAP_H
+
+#include <math.h>
+#include <stddef.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "aligned_allocator.h"
+#include "helpers.h"
+#include "map_file.h"
+#include "waypoint_grid.h"
+
+//
+// Waypoint map of the track. Owns all waypoint data and the tables derived
+//   from it (arc lengths, segment lengths, headings as cos/sin, lane centre
+//   offsets, spatial index) in one contiguous, cache line aligned structure
+//   of arrays laid out like the binary map file payload. A map loaded from a
+//   binary file points straight into the read-only mapping instead.
+//
+// A TrackMap never changes once loaded, so one instance can be shared by
+//   many planner threads. It is not copyable; pass it by reference or share
+//   it through a pointer.
+//
+class TrackMap {
+ public:
+  TrackMap() : n_(0), max_s_(0), lane_count_(0), lane_width_(0) {
+    for (int a = 0; a < MAP_ARRAY_COUNT; ++a) {
+      arrays_[a] = NULL;
+    }
+  }
+
+  // Build the map from waypoint vectors. max_s <= 0 uses the length of the
+  //   closed waypoint loop.
+  void assign(const vector<double> &x, const vector<double> &y,
+              const vector<double> &s, const vector<double> &dx,
+              const vector<double> &dy, double max_s, int lane_count = 3,
+              double lane_width = 4) {
+    mapped_.close();
+    n_ = x.size();
+    uint64_t offset[MAP_ARRAY_COUNT];
+    storage_.assign(mapFileLayout(n_, offset)/sizeof(double), 0.0);
+    double *arrays[MAP_ARRAY_COUNT];
+    for (int a = 0; a < MAP_ARRAY_COUNT; ++a) {
+      arrays[a] = storage_.data()+offset[a]/sizeof(double);
+      arrays_[a] = arrays[a];
+    }
+
+    std::copy(x.begin(), x.end(), arrays[MAP_X]);
+    std::copy(y.begin(), y.end(), arrays[MAP_Y]);
+    std::copy(s.begin(), s.end(), arrays[MAP_S]);
+    std::copy(dx.begin(), dx.end(), arrays[MAP_DX]);
+    std::copy(dy.begin(), dy.end(), arrays[MAP_DY]);
+
+    vector<double> arc_s = getArcLengths(x, y);
+    vector<double> heading_cos, heading_sin;
+    getHeadings(x, y, heading_cos, heading_sin);
+    std::copy(arc_s.begin(), arc_s.end(), arrays[MAP_ARC_S]);
+    std::copy(heading_cos.begin(), heading_cos.end(), arrays[MAP_HEADING_COS]);
+    std::copy(heading_sin.begin(), heading_sin.end(), arrays[MAP_HEADING_SIN]);
+    for (int i = 0; i < n_; ++i) {
+      arrays[MAP_SEG_LEN][i] = arc_s[i+1]-arc_s[i];
+    }
+
+    max_s_ = (max_s > 0) ? max_s : arc_s[n_];
+    lane_count_ = lane_count;
+    lane_width_ = lane_width;
+    buildIndexes();
+  }
+
+  // Load a map from the simulator's CSV format (x y s dx dy per line)
+  bool load_csv(const string &file, double max_s) {
+    vector<double> x, y, s, dx, dy;
+    std::ifstream in_map_(file.c_str(), std::ifstream::in);
+    string line;
+    while (getline(in_map_, line)) {
+      std::istringstream iss(line);
+      double x_i, y_i, s_i, dx_i, dy_i;
+      if (iss >> x_i >> y_i >> s_i >> dx_i >> dy_i) {
+        x.push_back(x_i);
+        y.push_back(y_i);
+        s.push_back(s_i);
+        dx.push_back(dx_i);
+        dy.push_back(dy_i);
+      }
+    }
+    if (x.size() < 2) {
+      return false;
+    }
+
+    assign(x, y, s, dx, dy, max_s);
+    return true;
+  }
+
+  // Map a binary map file; the arrays are used in place, without a copy
+  bool load_file(const string &file) {
+    if (!mapped_.open(file)) {
+      return false;
+    }
+    storage_.clear();
+    n_ = mapped_.count();
+    for (int a = 0; a < MAP_ARRAY_COUNT; ++a) {
+      arrays_[a] = mapped_.array((MapFileArray)a);
+    }
+    max_s_ = mapped_.max_s();
+    lane_count_ = mapped_.lane_count();
+    lane_width_ = mapped_.lane_width();
+    buildIndexes();
+    return true;
+  }
+
+  bool save_file(const string &file) const {
+    return writeMapFile(file, n_, max_s_, lane_count_, lane_width_, arrays_);
+  }
+
+  int size() const { return n_; }
+  // The max s value before wrapping around the track back to 0
+  double max_s() const { return max_s_; }
+
+  const double *x() const { return arrays_[MAP_X]; }
+  const double *y() const { return arrays_[MAP_Y]; }
+  const double *s() const { return arrays_[MAP_S]; }
+  const double *dx() const { return arrays_[MAP_DX]; }
+  const double *dy() const { return arrays_[MAP_DY]; }
+  const double *arc_s() const { return arrays_[MAP_ARC_S]; }
+  const double *seg_len() const { return arrays_[MAP_SEG_LEN]; }
+  const double *heading_cos() const { return arrays_[MAP_HEADING_COS]; }
+  const double *heading_sin() const { return arrays_[MAP_HEADING_SIN]; }
+
+  int lane_count() const { return lane_count_; }
+  double lane_width() const { return lane_width_; }
+  // d of the centre of a lane, counted from the yellow line
+  double lane_center(int lane) const { return lane_center_[lane]; }
+
+  const WaypointGrid &grid() const { return grid_; }
+
+ private:
+  TrackMap(const TrackMap &);
+  TrackMap &operator=(const TrackMap &);
+
+  void buildIndexes() {
+    grid_.build(x(), y(), n_);
+    lane_center_.resize(lane_count_);
+    for (int lane = 0; lane < lane_count_; ++lane) {
+      lane_center_[lane] = (lane+0.5)*lane_width_;
+    }
+  }
+
+  std::vector<double, AlignedAllocator<double> > storage_;
+  MappedMapFile mapped_;
+  const double *arrays_[MAP_ARRAY_COUNT];
+  int n_;
+  double max_s_;
+  int lane_count_;
+  double lane_width_;
+  vector<double> lane_center_;
+  WaypointGrid grid_;
+};
+
+//
+// Helpers taking the map as one TrackMap. They return positions by value and
+//   do not allocate.
+//
+
+// Calculate closest waypoint to current x, y position using the map's spatial
+//   index
+int ClosestWaypoint(double x, double y, const TrackMap &map) {
+  return map.grid().closest(x,y);
+}
+
+// Same as above, warm-started from the waypoint found on the previous call.
+//   A hint that does not lead to a waypoint in reach of the point falls back
+//   to the spatial index.
+int ClosestWaypoint(double x, double y, const TrackMap &map, int &hint) {
+  if (hint >= 0 && hint < map.size()) {
+    double dist;
+    int closest = ClimbToWaypoint(x,y,map.x(),map.y(),map.size(),hint,dist);
+    if (WaypointInReach(closest,dist,map.x(),map.y(),map.size())) {
+      hint = closest;
+      return closest;
+    }
+  }
+
+  hint = map.grid().closest(x,y);
+  return hint;
+}
+
+// Returns next waypoint of the closest waypoint
+int NextWaypoint(double x, double y, double theta, const TrackMap &map) {
+  return NextWaypoint(ClosestWaypoint(x,y,map),x,y,theta,map.x(),map.y(),
+                      map.size());
+}
+
+// Same as above, warm-started from the waypoint found on the previous call
+int NextWaypoint(double x, double y, double theta, const TrackMap &map,
+                 int &hint) {
+  return NextWaypoint(ClosestWaypoint(x,y,map,hint),x,y,theta,map.x(),map.y(),
+                      map.size());
+}
+
+// Transform from Cartesian x,y coordinates to Frenet s,d coordinates
+Frenet getFrenet(double x, double y, double theta, const TrackMap &map) {
+  int next_wp = NextWaypoint(x,y, theta, map);
+  return getFrenet(next_wp,x,y,map.x(),map.y(),map.size(),map.arc_s());
+}
+
+// Same as above, warm-started from the waypoint found on the previous call
+Frenet getFrenet(double x, double y, double theta, const TrackMap &map,
+                 int &hint) {
+  int next_wp = NextWaypoint(x,y, theta, map, hint);
+  return getFrenet(next_wp,x,y,map.x(),map.y(),map.size(),map.arc_s());
+}
+
+// Index of the map segment holding s, wrapped at max_s
+int SegmentAt(double s, const TrackMap &map, int &hint) {
+  return SegmentAt(s, map.s(), map.size(), map.max_s(), hint);
+}
+
+// Transform from Frenet s,d coordinates to Cartesian x,y on map segment
+//   prev_wp. Uses the precomputed headings, so it agrees with the trig in
+//   getXY() to within rounding (~1e-12 m).
+Cartesian getXY(int prev_wp, double s, double d, const TrackMap &map) {
+  double seg_s = s-map.s()[prev_wp];
+  double cos_h = map.heading_cos()[prev_wp];
+  double sin_h = map.heading_sin()[prev_wp];
+
+  Cartesian xy = {map.x()[prev_wp]+seg_s*cos_h+d*sin_h,
+                  map.y()[prev_wp]+seg_s*sin_h-d*cos_h};
+  return xy;
+}
+
+// Transform from Frenet s,d coordinates to Cartesian x,y, with s wrapped at
+//   max_s and the segment search warm-started from the segment found on the
+//   previous call
+Cartesian getXY(double s, double d, const TrackMap &map, int &hint) {
+  int prev_wp = SegmentAt(s, map, hint);
+  s = fmod(s, map.max_s());
+  if (s < 0) {
+    s += map.max_s();
+  }
+  return getXY(prev_wp, s, d, map);
+}
+
+// Same as above, without a hint
+Cartesian getXY(double s, double d, const TrackMap &map) {
+  int hint = -1;
+  return getXY(s, d, map, hint);
+}
+
+// Batch variant of getXY() writing into caller provided buffers
+void getXYBatch(const double *s, const double *d, double *x, double *y,
+                size_t n, const TrackMap &map) {
+  getXYBatch(s, d, x, y, n, map.s(), map.x(), map.y(), map.heading_cos(),
+             map.heading_sin(), map.size(), map.max_s());
+}
+
+#endif  // TRACK_MAP_H
@@ -0,0 +1,202 @@
+#ifndef TRACK_MODEL_H
+#define TRACK_MODEL_H
+
+#include <math.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+#include "spline.h"
+#include "track_map.h"
+
+//
+// Smooth model of the whole track. Splines x(s), y(s), dx(s) and dy(s) are
+//   fitted through the map waypoints once at startup, with a few waypoints
+//   repeated across the start line so the curve is smooth where s wraps at
+//   max_s. The splines are then resampled onto a uniform s grid, so a lookup
+//   is one multiply to find the sample plus a linear blend to the next one,
+//   with no search. The tangent is sampled as well, so Cartesian points can
+//   be projected back onto the track with a few Newton steps.
+//
+class TrackModel {
+ public:
+  TrackModel() : max_s_(0), ds_(1), inv_ds_(1), n_(0) {}
+  TrackModel(const TrackMap &map, double ds = 0.5) { build(map, ds); }
+
+  // Fit the track splines and sample them every ds metres
+  void build(const TrackMap &map, double ds = 0.5) {
+    const int wrap = 3;  // waypoints repeated on each side of the start line
+    int n = map.size();
+    max_s_ = map.max_s();
+
+    vector<double> knot_s, knot_x, knot_y, knot_dx, knot_dy;
+    for (int k = -wrap; k < n+wrap; ++k) {
+      int i = (k+n)%n;
+      double shift = (k < 0) ? -max_s_ : (k >= n) ? max_s_ : 0;
+      knot_s.push_back(map.s()[i]+shift);
+      knot_x.push_back(map.x()[i]);
+      knot_y.push_back(map.y()[i]);
+      knot_dx.push_back(map.dx()[i]);
+      knot_dy.push_back(map.dy()[i]);
+    }
+
+    tk::spline spline_x, spline_y, spline_dx, spline_dy;
+    spline_x.set_points(knot_s, knot_x);
+    spline_y.set_points(knot_s, knot_y);
+    spline_dx.set_points(knot_s, knot_dx);
+    spline_dy.set_points(knot_s, knot_dy);
+
+    // sample one extra point past max_s so blending never needs a wrap
+    n_ = (int)ceil(max_s_/ds);
+    ds_ = max_s_/n_;
+    inv_ds_ = 1/ds_;
+    x_.resize(n_+1);
+    y_.resize(n_+1);
+    dx_.resize(n_+1);
+    dy_.resize(n_+1);
+    tx_.resize(n_+1);
+    ty_.resize(n_+1);
+    for (int i = 0; i <= n_; ++i) {
+      double s = i*ds_;
+      x_[i] = spline_x(s);
+      y_[i] = spline_y(s);
+      double norm_dx = spline_dx(s);
+      double norm_dy = spline_dy(s);
+      double len = sqrt(norm_dx*norm_dx+norm_dy*norm_dy);
+      dx_[i] = norm_dx/len;
+      dy_[i] = norm_dy/len;
+      tx_[i] = spline_x.deriv(1, s);
+      ty_[i] = spline_y.deriv(1, s);
+    }
+  }
+
+  double max_s() const { return max_s_; }
+  double sample_spacing() const { return ds_; }
+
+  // Transform from Frenet s,d coordinates to Cartesian x,y on the smooth
+  //   track, with s wrapped at max_s
+  Cartesian getXY(double s, double d) const {
+    int i;
+    double t;
+    locate(s, i, t);
+    double x = x_[i]+t*(x_[i+1]-x_[i]);
+    double y = y_[i]+t*(y_[i+1]-y_[i]);
+    double dx = dx_[i]+t*(dx_[i+1]-dx_[i]);
+    double dy = dy_[i]+t*(dy_[i+1]-dy_[i]);
+
+    Cartesian xy = {x+d*dx, y+d*dy};
+    return xy;
+  }
+
+  // Batch variant of getXY() writing into caller provided buffers
+  void getXY(const double *s, const double *d, double *x, double *y,
+             size_t n) const {
+    for (size_t k = 0; k < n; ++k) {
+      Cartesian xy = getXY(s[k], d[k]);
+      x[k] = xy.x;
+      y[k] = xy.y;
+    }
+  }
+
+  // Unit normal (pointing towards increasing d) at s
+  Cartesian normal(double s) const {
+    int i;
+    double t;
+    locate(s, i, t);
+    Cartesian n = {dx_[i]+t*(dx_[i+1]-dx_[i]), dy_[i]+t*(dy_[i+1]-dy_[i])};
+    return n;
+  }
+
+  // Transform from Cartesian x,y coordinates to Frenet s,d coordinates by
+  //   projecting onto the smooth track, the exact inverse of getXY(). Newton
+  //   steps solve for the s whose normal line passes through x,y (for a
+  //   normal orthogonal to the track, the closest point), warm-started from
+  //   s_hint. They converge in two or three steps when the hint is within a
+  //   few metres, e.g. last frame's s of the same car. The number of steps
+  //   taken is added to *iterations.
+  Frenet getFrenet(double x, double y, double s_hint,
+                   int *iterations = NULL) const {
+    const int max_iterations = 10;
+    const double max_step = 50;    // keeps a poor hint from overshooting
+    const double tolerance = 1e-6;
+
+    double s = s_hint;
+    int i;
+    double t;
+    for (int k = 0; k < max_iterations; ++k) {
+      locate(s, i, t);
+      double ex = x-(x_[i]+t*(x_[i+1]-x_[i]));
+      double ey = y-(y_[i]+t*(y_[i+1]-y_[i]));
+      double tx = tx_[i]+t*(tx_[i+1]-tx_[i]);
+      double ty = ty_[i]+t*(ty_[i+1]-ty_[i]);
+      double nx = dx_[i]+t*(dx_[i+1]-dx_[i]);
+      double ny = dy_[i]+t*(dy_[i+1]-dy_[i]);
+      double dnx = (dx_[i+1]-dx_[i])*inv_ds_;
+      double dny = (dy_[i+1]-dy_[i])*inv_ds_;
+
+      // cross product of the offset with the normal, zero on the normal line
+      double g = ex*ny-ey*nx;
+      double dg = ty*nx-tx*ny+ex*dny-ey*dnx;
+      if (dg <= 0) {
+        // past the centre of curvature, drop the curvature term
+        dg = ty*nx-tx*ny;
+      }
+      double step = std::max(-max_step, std::min(max_step, -g/dg));
+      s += step;
+      if (iterations != NULL) {
+        ++*iterations;
+      }
+      if (fabs(step) < tolerance) {
+        break;
+      }
+    }
+
+    locate(s, i, t);
+    double ex = x-(x_[i]+t*(x_[i+1]-x_[i]));
+    double ey = y-(y_[i]+t*(y_[i+1]-y_[i]));
+    double nx = dx_[i]+t*(dx_[i+1]-dx_[i]);
+    double ny = dy_[i]+t*(dy_[i+1]-dy_[i]);
+
+    Frenet sd = {(i+t)*ds_, (ex*nx+ey*ny)/(nx*nx+ny*ny)};
+    return sd;
+  }
+
+  // Batch variant of getFrenet(). s holds the hints on input and the
+  //   projected s on output, so a previous path or all sensor fusion cars can
+  //   be projected in one call. Returns the total number of Newton steps.
+  int getFrenet(const double *x, const double *y, double *s, double *d,
+                size_t n) const {
+    int iterations = 0;
+    for (size_t k = 0; k < n; ++k) {
+      Frenet sd = getFrenet(x[k], y[k], s[k], &iterations);
+      s[k] = sd.s;
+      d[k] = sd.d;
+    }
+    return iterations;
+  }
+
+ private:
+  // Sample index and blend factor of s, wrapped into [0, max_s)
+  void locate(double s, int &i, double &t) const {
+    double u = s*inv_ds_;
+    if (u < 0 || u >= n_) {
+      u -= n_*floor(u/n_);
+    }
+    i = (int)u;
+    if (i >= n_) {
+      i = n_-1;
+    }
+    t = u-i;
+  }
+
+  vector<double> x_;
+  vector<double> y_;
+  vector<double> dx_;
+  vector<double> dy_;
+  vector<double> tx_;
+  vector<double> ty_;
+  double max_s_;
+  double ds_, inv_ds_;
+  int n_;
+};
+
+#endif  // TRACK_MODEL_H
@@ -0,0 +1,198 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <stdint.h>
+#include <vector>
+#include "vehicle_table.h"
+
+//
+// Tracks of the other vehicles across frames, keyed by their sensor fusion
+//   ID. Each frame's vehicle table updates the track of every ID it holds,
+//   and tracks not seen for a timeout are dropped. The tracker only keeps
+//   identity and age; Predictor filters the motion of each track in a slot
+//   of its own.
+//
+// Tracks live in a pool: a track keeps its slot for as long as it exists,
+//   so slot indices can be held across frames. IDs map to slots through an
+//   open addressing hash map. Pool and map grow only when more vehicles are
+//   tracked than ever before, so updates do not allocate in steady state.
+//
+
+// One tracked vehicle
+struct Track {
+  int id;
+  double s;           // position at the last update
+  double d;
+  double first_seen;  // time of the first and the last update, s
+  double last_seen;
+  int updates;        // frames the vehicle has been seen in
+};
+
+class Tracker {
+ public:
+  Tracker(int capacity = 64, double timeout = 1.0)
+      : timeout_(timeout), size_(0) {
+    reserve(capacity);
+  }
+
+  // Update the tracks from the vehicles of the frame at time seconds
+  void update(const VehicleTable &vehicles, double time) {
+    int n = vehicles.size();
+    row_slot_.resize(n);
+    for (int i = 0; i < n; ++i) {
+      int slot = find_slot(vehicles.id()[i]);
+      if (slot < 0) {
+        slot = insert(vehicles.id()[i]);
+        start(tracks_[slot], vehicles, i, time);
+      } else {
+        advance(tracks_[slot], vehicles, i, time);
+      }
+      row_slot_[i] = slot;
+    }
+
+    // drop the tracks of vehicles that have left
+    for (int slot = 0; slot < capacity(); ++slot) {
+      if (alive_[slot] && time-tracks_[slot].last_seen > timeout_) {
+        erase(slot);
+      }
+    }
+  }
+
+  // Drop all tracks
+  void clear() {
+    for (int slot = 0; slot < capacity(); ++slot) {
+      if (alive_[slot]) {
+        erase(slot);
+      }
+    }
+    row_slot_.clear();
+  }
+
+  // Number of live tracks, and the number the pool holds without growing
+  int size() const { return size_; }
+  int capacity() const { return tracks_.size(); }
+
+  // Slot of the track with the given ID, -1 if it is not tracked
+  int find(int id) const { return find_slot(id); }
+  // Slot of vehicle i of the last update's table
+  int slot(int i) const { return row_slot_[i]; }
+  const Track &track(int slot) const { return tracks_[slot]; }
+  bool alive(int slot) const { return alive_[slot] != 0; }
+
+ private:
+  // Grow the pool to capacity tracks and rehash; never shrinks
+  void reserve(int capacity) {
+    if (capacity <= (int)tracks_.size()) {
+      return;
+    }
+    int old_capacity = tracks_.size();
+    tracks_.resize(capacity);
+    alive_.resize(capacity, 0);
+    free_.reserve(capacity);
+    for (int slot = old_capacity; slot < capacity; ++slot) {
+      free_.insert(free_.begin(), slot);
+    }
+    row_slot_.reserve(capacity);
+
+    // hash map at most half full
+    size_t buckets = 16;
+    while (buckets < 2*(size_t)capacity) {
+      buckets *= 2;
+    }
+    buckets_.assign(buckets, -1);
+    for (int slot = 0; slot < old_capacity; ++slot) {
+      if (alive_[slot]) {
+        size_t b = bucket(tracks_[slot].id);
+        while (buckets_[b] >= 0) {
+          b = (b+1)&(buckets_.size()-1);
+        }
+        buckets_[b] = slot;
+      }
+    }
+  }
+
+  size_t bucket(int id) const {
+    uint32_t h = (uint32_t)id*2654435761u;
+    return (h^(h >> 16))&(buckets_.size()-1);
+  }
+
+  int find_slot(int id) const {
+    size_t b = bucket(id);
+    while (buckets_[b] >= 0) {
+      if (tracks_[buckets_[b]].id == id) {
+        return buckets_[b];
+      }
+      b = (b+1)&(buckets_.size()-1);
+    }
+    return -1;
+  }
+
+  // Take a free slot for a new ID and map it
+  int insert(int id) {
+    if (free_.empty()) {
+      reserve(2*capacity());
+    }
+    int slot = free_.back();
+    free_.pop_back();
+    alive_[slot] = 1;
+    tracks_[slot].id = id;
+    ++size_;
+    size_t b = bucket(id);
+    while (buckets_[b] >= 0) {
+      b = (b+1)&(buckets_.size()-1);
+    }
+    buckets_[b] = slot;
+    return slot;
+  }
+
+  // Unmap a track and free its slot, shifting later entries of its probe
+  //   run back so lookups need no tombstones
+  void erase(int slot) {
+    size_t mask = buckets_.size()-1;
+    size_t b = bucket(tracks_[slot].id);
+    while (buckets_[b] != slot) {
+      b = (b+1)&mask;
+    }
+    size_t hole = b;
+    for (size_t next = (hole+1)&mask; buckets_[next] >= 0;
+         next = (next+1)&mask) {
+      size_t home = bucket(tracks_[buckets_[next]].id);
+      // move the entry back unless its home lies in (hole, next]
+      if (((next-home)&mask) >= ((next-hole)&mask)) {
+        buckets_[hole] = buckets_[next];
+        hole = next;
+      }
+    }
+    buckets_[hole] = -1;
+    alive_[slot] = 0;
+    free_.push_back(slot);
+    --size_;
+  }
+
+  static void start(Track &track, const VehicleTable &vehicles, int i,
+                    double time) {
+    track.s = vehicles.s()[i];
+    track.d = vehicles.d()[i];
+    track.first_seen = time;
+    track.last_seen = time;
+    track.updates = 1;
+  }
+
+  static void advance(Track &track, const VehicleTable &vehicles, int i,
+                      double time) {
+    track.s = vehicles.s()[i];
+    track.d = vehicles.d()[i];
+    track.last_seen = time;
+    ++track.updates;
+  }
+
+  double timeout_;
+  int size_;
+  std::vector<Track> tracks_;
+  std::vector<char> alive_;
+  std::vector<int> free_;      // free slots, the lowest last
+  std::vector<int> buckets_;   // slot of each hash bucket, -1 if empty
+  std::vector<int> row_slot_;  // slot of each vehicle of the last update
+};
+
+#endif  // TRACKER_H
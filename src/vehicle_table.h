@@ -0,0 +1,87 @@
+#ifndef VEHICLE_TABLE_H
+#define VEHICLE_TABLE_H
+
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+
+//
+// The other vehicles of one telemetry frame as a structure of arrays. The
+//   sensor fusion list is parsed once per frame, in a single pass, and all
+//   behaviour checks then read plain arrays instead of walking the JSON.
+//
+// The table keeps its storage between frames, so refilling it does not
+//   allocate once it has seen the largest number of vehicles.
+//
+class VehicleTable {
+ public:
+  VehicleTable() : horizon_(0) {}
+
+  // Refill from the simulator's sensor fusion list, rows of
+  //   [id, x, y, vx, vy, s, d]. Predicted s is the constant speed position
+  //   horizon seconds ahead.
+  template <typename SensorFusion>
+  void assign(const SensorFusion &sensor_fusion, double horizon) {
+    clear();
+    horizon_ = horizon;
+    for (size_t i = 0; i < sensor_fusion.size(); ++i) {
+      const auto &row = sensor_fusion[i];
+      push_back((int)row[0], (double)row[1], (double)row[2], (double)row[3],
+                (double)row[4], (double)row[5], (double)row[6]);
+    }
+  }
+
+  void clear() {
+    id_.clear();
+    x_.clear();
+    y_.clear();
+    vx_.clear();
+    vy_.clear();
+    s_.clear();
+    d_.clear();
+    speed_.clear();
+    future_s_.clear();
+  }
+
+  void push_back(int id, double x, double y, double vx, double vy, double s,
+                 double d) {
+    double speed = sqrt(vx*vx+vy*vy);
+    id_.push_back(id);
+    x_.push_back(x);
+    y_.push_back(y);
+    vx_.push_back(vx);
+    vy_.push_back(vy);
+    s_.push_back(s);
+    d_.push_back(d);
+    speed_.push_back(speed);
+    future_s_.push_back(s+horizon_*speed);
+  }
+
+  int size() const { return id_.size(); }
+  // Prediction horizon of future_s, in seconds
+  double horizon() const { return horizon_; }
+
+  const int *id() const { return id_.data(); }
+  const double *x() const { return x_.data(); }
+  const double *y() const { return y_.data(); }
+  const double *vx() const { return vx_.data(); }
+  const double *vy() const { return vy_.data(); }
+  const double *s() const { return s_.data(); }
+  const double *d() const { return d_.data(); }
+  const double *speed() const { return speed_.data(); }
+  const double *future_s() const { return future_s_.data(); }
+
+ private:
+  std::vector<int> id_;
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> vx_;
+  std::vector<double> vy_;
+  std::vector<double> s_;
+  std::vector<double> d_;
+  std::vector<double> speed_;
+  std::vector<double> future_s_;
+  double horizon_;
+};
+
+#endif  // VEHICLE_TABLE_H
@@ -0,0 +1,151 @@
+#ifndef WAYPOINT_GRID_H
+#define WAYPOINT_GRID_H
+
+#include <math.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+//
+// Uniform grid spatial index over the map waypoints, built once when the map
+//   is loaded. Closest waypoint queries only visit the cells around the query
+//   point, so they cost O(1) on average instead of a scan over the whole map.
+//
+class WaypointGrid {
+ public:
+  WaypointGrid() : x0_(0), y0_(0), cell_(1), inv_cell_(1), nx_(0), ny_(0) {}
+  WaypointGrid(const std::vector<double> &maps_x,
+               const std::vector<double> &maps_y) {
+    build(maps_x, maps_y);
+  }
+
+  void build(const std::vector<double> &maps_x,
+             const std::vector<double> &maps_y) {
+    build(maps_x.data(), maps_y.data(), maps_x.size());
+  }
+
+  // (Re)build the index. The cell size follows the mean waypoint spacing so
+  //   the track crosses about one cell per waypoint, but is grown as needed
+  //   to keep the number of cells within a small multiple of the waypoints.
+  void build(const double *maps_x, const double *maps_y, int n) {
+    maps_x_.assign(maps_x, maps_x+n);
+    maps_y_.assign(maps_y, maps_y+n);
+
+    double x_max = maps_x[0];
+    double y_max = maps_y[0];
+    x0_ = maps_x[0];
+    y0_ = maps_y[0];
+    double spacing = 0;
+    for (int i = 0; i < n; ++i) {
+      x0_ = std::min(x0_, maps_x[i]);
+      y0_ = std::min(y0_, maps_y[i]);
+      x_max = std::max(x_max, maps_x[i]);
+      y_max = std::max(y_max, maps_y[i]);
+      int next = (i+1)%n;
+      spacing += sqrt((maps_x[next]-maps_x[i])*(maps_x[next]-maps_x[i])+
+                      (maps_y[next]-maps_y[i])*(maps_y[next]-maps_y[i]));
+    }
+    spacing /= n;
+
+    double area = (x_max-x0_)*(y_max-y0_);
+    cell_ = std::max(spacing, sqrt(area/(4.0*n)));
+    if (cell_ <= 0) {
+      cell_ = 1;
+    }
+    inv_cell_ = 1/cell_;
+    nx_ = (int)((x_max-x0_)*inv_cell_)+1;
+    ny_ = (int)((y_max-y0_)*inv_cell_)+1;
+
+    // bucket the waypoints by cell, stored as one contiguous array with an
+    //   offset table (counting sort keeps waypoints of a cell in index order)
+    cell_start_.assign(nx_*ny_+1, 0);
+    for (int i = 0; i < n; ++i) {
+      ++cell_start_[cellOf(maps_x[i], maps_y[i])+1];
+    }
+    for (int c = 0; c < nx_*ny_; ++c) {
+      cell_start_[c+1] += cell_start_[c];
+    }
+    cell_items_.resize(n);
+    std::vector<int> fill(cell_start_.begin(), cell_start_.end()-1);
+    for (int i = 0; i < n; ++i) {
+      cell_items_[fill[cellOf(maps_x[i], maps_y[i])]++] = i;
+    }
+  }
+
+  int size() const { return maps_x_.size(); }
+
+  // Index of the waypoint closest to x, y. Ties resolve to the lowest index,
+  //   the same as the linear scan in ClosestWaypoint().
+  int closest(double x, double y) const {
+    int cx = clampCell((int)floor((x-x0_)*inv_cell_), nx_);
+    int cy = clampCell((int)floor((y-y0_)*inv_cell_), ny_);
+
+    int best = -1;
+    double best_d2 = 0;
+    for (int r = 0; ; ++r) {
+      int i0 = cx-r, i1 = cx+r, j0 = cy-r, j1 = cy+r;
+      for (int j = std::max(j0, 0); j <= std::min(j1, ny_-1); ++j) {
+        // only the ring of cells at Chebyshev distance r is new
+        int step = (j == j0 || j == j1) ? 1 : std::max(i1-i0, 1);
+        for (int i = i0; i <= i1; i += step) {
+          if (i >= 0 && i < nx_) {
+            scanCell(j*nx_+i, x, y, best, best_d2);
+          }
+        }
+      }
+
+      // lower bound on the distance to any cell outside the searched square,
+      //   ignoring the sides that already reached the edge of the grid
+      bool done = true;
+      double bound = HUGE_VAL;
+      if (i0 > 0) { done = false; bound = std::min(bound, x-(x0_+i0*cell_)); }
+      if (i1 < nx_-1) { done = false; bound = std::min(bound, x0_+(i1+1)*cell_-x); }
+      if (j0 > 0) { done = false; bound = std::min(bound, y-(y0_+j0*cell_)); }
+      if (j1 < ny_-1) { done = false; bound = std::min(bound, y0_+(j1+1)*cell_-y); }
+      if (done || (best >= 0 && best_d2 <= bound*bound)) {
+        return best;
+      }
+    }
+  }
+
+  // Batch variant of closest() for many query points at once
+  void closest(const double *xs, const double *ys, int *out, size_t n) const {
+    for (size_t k = 0; k < n; ++k) {
+      out[k] = closest(xs[k], ys[k]);
+    }
+  }
+
+ private:
+  static int clampCell(int c, int n) {
+    return std::min(std::max(c, 0), n-1);
+  }
+
+  int cellOf(double x, double y) const {
+    int i = clampCell((int)((x-x0_)*inv_cell_), nx_);
+    int j = clampCell((int)((y-y0_)*inv_cell_), ny_);
+    return j*nx_+i;
+  }
+
+  void scanCell(int c, double x, double y, int &best, double &best_d2) const {
+    for (int k = cell_start_[c]; k < cell_start_[c+1]; ++k) {
+      int i = cell_items_[k];
+      double dx = maps_x_[i]-x;
+      double dy = maps_y_[i]-y;
+      double d2 = dx*dx+dy*dy;
+      if (best < 0 || d2 < best_d2 || (d2 == best_d2 && i < best)) {
+        best = i;
+        best_d2 = d2;
+      }
+    }
+  }
+
+  std::vector<double> maps_x_;
+  std::vector<double> maps_y_;
+  std::vector<int> cell_start_;
+  std::vector<int> cell_items_;
+  double x0_, y0_;
+  double cell_, inv_cell_;
+  int nx_, ny_;
+};
+
+#endif  // WAYPOINT_GRID_H